@@ -39,6 +39,7 @@ typedef struct _optlist         OPTLIST;
 typedef struct _scr             SCR;
 typedef struct _script          SCRIPT;
 typedef struct _seq             SEQ;
+typedef struct _sindex          SINDEX;
 typedef struct _tag             TAG;
 typedef struct _tagf            TAGF;
 typedef struct _tagq            TAGQ;
@@ -105,5 +106,6 @@ extern enum pmode { MODE_EX, MODE_VI, MODE_VIEW } pmode;
 #include "exf.h"
 #include "log.h"
 #include "mem.h"
+#include "thread.h"
 
 #include "com_extern.h"
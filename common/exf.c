@@ -422,6 +422,7 @@ file_init(SCR *sp, FREF *frp, char *rcv_name, int flags)
                 O_CLR(sp, O_READONLY);
 
         /* Switch... */
+        search_ifree(sp);
         ++ep->refcnt;
         sp->ep = ep;
         sp->frp = frp;
@@ -47,6 +47,10 @@ struct _exf {
         dir_t    lundo;                 /* Last undo direction. */
 
         LIST_HEAD(_markh, _lmark) marks;/* Linked list of file MARK's. */
+        LMARK  **m_ord;                 /* MARK's in line order. */
+        long    *m_fen;                 /* MARK line deltas. */
+        size_t   m_cnt;                 /* MARK's in the line order. */
+        size_t   m_max;                 /* Line order allocated size. */
 
         dev_t    mdev;                  /* Device. */
         ino_t    minode;                /* Inode. */
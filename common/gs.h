@@ -94,6 +94,7 @@ struct _gs {
 #define EXCMD_RUNNING(gp)       (LIST_FIRST(&(gp)->ecq)->clen != 0)
         LIST_HEAD(_excmdh, _excmd) ecq; /* Ex command linked list.         */
         EXCMD    excmd;                 /* Default ex command structure.   */
+        int      bulk;                  /* Ex bulk change nesting level.   */
         char     *if_name;              /* Current associated file.        */
         recno_t   if_lno;               /* Current associated line number. */
 
@@ -771,7 +771,18 @@ retry:  istimeout = remap_cnt = 0;
                  */
                 if (F_ISSET(gp, G_SCRWIN) && sscr_input(sp))
                         return (1);
-loop:           if (gp->scr_event(sp, argp,
+                /*
+                 * If there's idle work to do, do it a batch at a time,
+                 * polling for input in between.  The batches are short,
+                 * so a key typed during one isn't held up for long.
+                 */
+loop:           if (LF_ISSET(EC_IDLE) && timeout == 0 && search_idle(sp)) {
+                        if (gp->scr_event(sp, argp,
+                            LF_ISSET(EC_INTERRUPT | EC_QUOTED | EC_RAW), 1))
+                                return (1);
+                        if (argp->e_event == E_TIMEOUT)
+                                goto loop;
+                } else if (gp->scr_event(sp, argp,
                     LF_ISSET(EC_INTERRUPT | EC_QUOTED | EC_RAW), timeout))
                         return (1);
                 switch (argp->e_event) {
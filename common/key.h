@@ -180,6 +180,7 @@ extern KEYLIST keylist[];
 #define EC_QUOTED       0x010           /* Try to quote next character */
 #define EC_RAW          0x020           /* Any next character. XXX: not used. */
 #define EC_TIMEOUT      0x040           /* Timeout to next character. */
+#define EC_IDLE         0x080           /* Do idle work while waiting. */
 
 /* Flags describing text input special cases. */
 #define TXT_ADDNEWLINE  0x00000001      /* Replay starts on a new line. */
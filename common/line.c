@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdio.h>
+#include <bsd_stdlib.h>
 #include <bsd_string.h>
 
 #include "common.h"
@@ -188,11 +189,12 @@ db_delete(SCR *sp, recno_t lno)
                 return (1);
         }
 
-        /* Update marks, @ and global commands. */
+        /* Update marks, @ and global commands, and the search index. */
         if (mark_insdel(sp, LINE_DELETE, lno))
                 return (1);
         if (ex_g_insdel(sp, LINE_DELETE, lno))
                 return (1);
+        search_insdel(sp, LINE_DELETE, lno);
 
         /* Log change. */
         log_line(sp, lno, LOG_LINE_DELETE);
@@ -266,12 +268,13 @@ db_append(SCR *sp, int update, recno_t lno, char *p, size_t len)
         /* Log change. */
         log_line(sp, lno + 1, LOG_LINE_APPEND);
 
-        /* Update marks, @ and global commands. */
+        /* Update marks, @ and global commands, and the search index. */
         rval = 0;
         if (mark_insdel(sp, LINE_INSERT, lno + 1))
                 rval = 1;
         if (ex_g_insdel(sp, LINE_INSERT, lno + 1))
                 rval = 1;
+        search_insdel(sp, LINE_INSERT, lno + 1);
 
         /*
          * Update screen.
@@ -332,12 +335,13 @@ db_insert(SCR *sp, recno_t lno, char *p, size_t len)
         /* Log change. */
         log_line(sp, lno, LOG_LINE_INSERT);
 
-        /* Update marks, @ and global commands. */
+        /* Update marks, @ and global commands, and the search index. */
         rval = 0;
         if (mark_insdel(sp, LINE_INSERT, lno))
                 rval = 1;
         if (ex_g_insdel(sp, LINE_INSERT, lno))
                 rval = 1;
+        search_insdel(sp, LINE_INSERT, lno);
 
         /* Update screen. */
         return (scr_update(sp, lno, LINE_INSERT, 1) || rval);
@@ -388,10 +392,332 @@ db_set(SCR *sp, recno_t lno, char *p, size_t len)
         /* Log after change. */
         log_line(sp, lno, LOG_LINE_RESET_F);
 
+        /* Update the search index. */
+        search_insdel(sp, LINE_RESET, lno);
+
         /* Update screen. */
         return (scr_update(sp, lno, LINE_RESET, 1));
 }
 
+/*
+ * db_move --
+ *      Move lines fl through ll to after line tl, which isn't one of them.
+ *
+ * Moving a line at a time goes back and forth between the two places in
+ * the file, and every database search starts over from the top of the
+ * tree.  Instead, copy the lines out a batch at a time, add them after
+ * the destination, then delete them from the source, so the searches
+ * stay on the same pages.  The lines are logged as a single move, and
+ * undone by moving them back, so their text isn't logged.
+ *
+ * PUBLIC: int db_move(SCR *, recno_t, recno_t, recno_t);
+ */
+
+int
+db_move(SCR *sp, recno_t fl, recno_t ll, recno_t tl)
+{
+        EXF *ep;
+        LBATCH b;
+        LMARK *lmp;
+        recno_t cnt, i, lno, mlno, ofl, oll, otl;
+        int nolog;
+
+        /* Check for no underlying file. */
+        if ((ep = sp->ep) == NULL) {
+                ex_emsg(sp, NULL, EXM_NOFILEYET);
+                return (1);
+        }
+
+        /*
+         * The marks on the lines move with them, except for the absolute
+         * mark, which is deleted with the line.  That's logged by the
+         * delete, but the line changes aren't logged, so log it here.
+         */
+        LIST_FOREACH(lmp, &ep->marks, q)
+                if (lmp->name == ABSMARK1 && !F_ISSET(lmp, MARK_DELETED) &&
+                    (mlno = mark_lno(sp, lmp)) >= fl && mlno <= ll)
+                        (void)log_mark(sp, lmp);
+
+        ofl = fl;
+        oll = ll;
+        otl = tl;
+        nolog = F_ISSET(ep, F_NOLOG);
+        F_SET(ep, F_NOLOG);
+        memset(&b, 0, sizeof(LBATCH));
+        while (fl <= ll) {
+                if (thread_batch(sp, &b, fl, ll))
+                        goto err;
+                cnt = b.cnt;
+                for (i = 0; i < cnt; ++i)
+                        if (db_append(sp, 1, tl + i,
+                            LBATCH_LINE(&b, i), LBATCH_LEN(&b, i)))
+                                goto err;
+
+                /* The lines being moved up are now after the new ones. */
+                lno = tl < fl ? fl + cnt : fl;
+                LIST_FOREACH(lmp, &ep->marks, q)
+                        if (lmp->name != ABSMARK1 &&
+                            (mlno = mark_lno(sp, lmp)) >= lno &&
+                            mlno < lno + cnt &&
+                            mark_setlno(sp, lmp, tl + 1 + (mlno - lno)))
+                                goto err;
+                for (i = cnt; i > 0; --i)
+                        if (db_delete(sp, lno + i - 1))
+                                goto err;
+
+                /*
+                 * Lines moved down end at the destination line, lines
+                 * moved up are followed by the rest of the lines.
+                 */
+                if (tl < fl) {
+                        fl += cnt;
+                        tl += cnt;
+                } else
+                        ll -= cnt;
+        }
+        thread_bfree(&b);
+        if (!nolog)
+                F_CLR(ep, F_NOLOG);
+        return (log_move(sp, ofl, oll, otl));
+
+err:    thread_bfree(&b);
+        if (!nolog)
+                F_CLR(ep, F_NOLOG);
+        return (1);
+}
+
+/*
+ * db_rset --
+ *      Stage storing a line in the file.
+ *
+ * Commands that change a range of lines, e.g. shifting or joining them,
+ * stage the changes with db_rset and db_rdelete, and apply them with
+ * db_rcommit.  The changes are applied in the order they were staged,
+ * and then logged as a single record, which is a lot cheaper than doing
+ * the work for each line.  Staged changes aren't visible until they're
+ * applied, so a line can't be read back or staged twice.  If too much
+ * is staged, the changes made so far are applied.
+ *
+ * PUBLIC: int db_rset(SCR *, LRANGE *, recno_t, char *, size_t);
+ */
+
+int
+db_rset(SCR *sp, LRANGE *rp, recno_t lno, char *p, size_t len)
+{
+        size_t olen;
+        char *op;
+
+        /* Check for no underlying file. */
+        if (sp->ep == NULL) {
+                ex_emsg(sp, NULL, EXM_NOFILEYET);
+                return (1);
+        }
+
+        /*
+         * Stage the line before and after the change.  As in log_line,
+         * if the first line doesn't exist the file was empty, and it's
+         * replaced by the new line.
+         */
+        if (db_get(sp, lno, DBG_NOCACHE, &op, &olen)) {
+                if (lno != 1) {
+                        db_err(sp, lno);
+                        return (1);
+                }
+                olen = 0;
+                op = "";
+        }
+        if (db_radd(sp, rp, lno, LOG_LINE_RESET_B, op, olen) ||
+            db_radd(sp, rp, lno, LOG_LINE_RESET_F, p, len))
+                return (1);
+        ++rp->cnt;
+        return (rp->len < LRANGE_MAX ? 0 : db_rcommit(sp, rp));
+}
+
+/*
+ * db_rdelete --
+ *      Stage deleting a line from the file.
+ *
+ * PUBLIC: int db_rdelete(SCR *, LRANGE *, recno_t);
+ */
+
+int
+db_rdelete(SCR *sp, LRANGE *rp, recno_t lno)
+{
+        size_t len;
+        char *p;
+
+        /* Check for no underlying file. */
+        if (sp->ep == NULL) {
+                ex_emsg(sp, NULL, EXM_NOFILEYET);
+                return (1);
+        }
+
+        if (db_get(sp, lno, DBG_FATAL | DBG_NOCACHE, &p, &len) ||
+            db_radd(sp, rp, lno, LOG_LINE_DELETE, p, len))
+                return (1);
+        ++rp->cnt;
+        return (rp->len < LRANGE_MAX ? 0 : db_rcommit(sp, rp));
+}
+
+/*
+ * db_rcommit --
+ *      Apply the staged changes.
+ *
+ * PUBLIC: int db_rcommit(SCR *, LRANGE *);
+ */
+
+int
+db_rcommit(SCR *sp, LRANGE *rp)
+{
+        DBT data, key;
+        EXF *ep;
+        recno_t lno;
+        size_t len, off;
+        int bulk, rval;
+        char *p;
+
+        if (rp->cnt == 0)
+                return (0);
+
+        /* Check for no underlying file. */
+        if ((ep = sp->ep) == NULL) {
+                ex_emsg(sp, NULL, EXM_NOFILEYET);
+                return (1);
+        }
+
+        /*
+         * Update the screen maps once, when all of the changes are done,
+         * unless it's just the one line.
+         */
+        if ((bulk = rp->cnt > 1) != 0)
+                vs_bulk(sp, 1);
+
+        for (off = sizeof(unsigned char);
+            off < rp->len; off += len + 2 * sizeof(size_t)) {
+                memmove(&len, rp->bp + off, sizeof(size_t));
+                p = rp->bp + off + sizeof(size_t);
+                memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
+
+                /* The put returns the record number in the key. */
+                key.data = &lno;
+                key.size = sizeof(lno);
+                switch (*p) {
+                case LOG_LINE_DELETE:
+                        /*
+                         * Update marks, @ and global commands, and the
+                         * search index.
+                         */
+                        if (mark_insdel(sp, LINE_DELETE, lno))
+                                goto err;
+                        if (ex_g_insdel(sp, LINE_DELETE, lno))
+                                goto err;
+                        search_insdel(sp, LINE_DELETE, lno);
+
+                        /* Update file. */
+                        if (ep->db->del(ep->db, &key, 0) == 1) {
+                                msgq(sp, M_SYSERR,
+                                    "unable to delete line %'lu",
+                                    (unsigned long)lno);
+                                goto err;
+                        }
+
+                        /* Flush the cache, update line count. */
+                        if (lno <= ep->c_lno)
+                                ep->c_lno = OOBLNO;
+                        if (ep->c_nlines != OOBLNO)
+                                --ep->c_nlines;
+
+                        if (scr_update(sp, lno, LINE_DELETE, 1))
+                                goto err;
+                        break;
+                case LOG_LINE_RESET_F:
+                        /* Update file. */
+                        data.data = p + sizeof(unsigned char) + sizeof(recno_t);
+                        data.size = len - sizeof(unsigned char) - sizeof(recno_t);
+                        if (ep->db->put(ep->db, &key, &data, 0) == -1) {
+                                msgq(sp, M_SYSERR,
+                                    "unable to store line %'lu",
+                                    (unsigned long)lno);
+                                goto err;
+                        }
+
+                        /* Flush the cache. */
+                        if (lno == ep->c_lno)
+                                ep->c_lno = OOBLNO;
+
+                        search_insdel(sp, LINE_RESET, lno);
+                        if (scr_update(sp, lno, LINE_RESET, 1))
+                                goto err;
+                        break;
+                }
+        }
+
+        rval = 0;
+        if (0) {
+                /* Only log the changes that were made. */
+err:            rval = 1;
+                rp->len = off;
+        }
+
+        /* File now dirty. */
+        if (rp->len > sizeof(unsigned char)) {
+                if (F_ISSET(ep, F_FIRSTMODIFY))
+                        (void)rcv_init(sp);
+                F_SET(ep, F_MODIFIED | F_RCV_SYNC);
+        }
+
+        /* Log the changes. */
+        (void)log_range(sp, rp);
+
+        if (bulk)
+                vs_bulk(sp, 0);
+        rp->len = rp->cnt = 0;
+        return (rval);
+}
+
+/*
+ * db_rfree --
+ *      Release the memory held by a set of staged changes.
+ *
+ * PUBLIC: void db_rfree(LRANGE *);
+ */
+
+void
+db_rfree(LRANGE *rp)
+{
+        free(rp->bp);
+        memset(rp, 0, sizeof(LRANGE));
+}
+
+/*
+ * db_radd --
+ *      Add a line record to the log record for a set of staged changes.
+ *
+ * PUBLIC: int db_radd(SCR *, LRANGE *, recno_t, unsigned int, char *, size_t);
+ */
+
+int
+db_radd(SCR *sp, LRANGE *rp, recno_t lno, unsigned int action,
+    char *p, size_t len)
+{
+        size_t rlen;
+        char *t;
+
+        if (rp->len == 0)
+                rp->len = sizeof(unsigned char);
+        rlen = sizeof(unsigned char) + sizeof(recno_t) + len;
+        BINC_RET(sp, rp->bp, rp->blen, rp->len + rlen + 2 * sizeof(size_t));
+        t = rp->bp + rp->len;
+        memmove(t, &rlen, sizeof(size_t));
+        t += sizeof(size_t);
+        *t = action;
+        memmove(t + sizeof(unsigned char), &lno, sizeof(recno_t));
+        memmove(t + sizeof(unsigned char) + sizeof(recno_t), p, len);
+        memmove(t + rlen, &rlen, sizeof(size_t));
+        rp->len += rlen + 2 * sizeof(size_t);
+        return (0);
+}
+
 /*
  * db_exist --
  *      Return if a line exists.
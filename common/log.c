@@ -46,6 +46,10 @@
  *      LOG_LINE_RESET_F        recno_t         char *
  *      LOG_LINE_RESET_B        recno_t         char *
  *      LOG_MARK                LMARK
+ *      LOG_LINE_RANGE          changes
+ *      LOG_LINE_MOVE           recno_t         recno_t         recno_t
+ *      LOG_LINE_SWAP_B         recno_t         char *
+ *      LOG_LINE_SWAP_F         recno_t         char *
  *
  * We do before image physical logging.  This means that the editor layer
  * MAY NOT modify records in place, even if simply deleting or overwriting
@@ -62,6 +66,21 @@
  * first LOG_CURSOR_INIT record before a change.  Roll-forward is done in a
  * similar fashion.
  *
+ * A LOG_LINE_RANGE record holds the line records for a set of changes that
+ * were applied together, see log.h.  Rolling it back or forward rolls back
+ * or forward each of the line records it holds, in the right order.  It
+ * doesn't hold both images of a changed line: each pair of LOG_LINE_RESET
+ * records is logged as a LOG_LINE_SWAP_B record, the line before the
+ * change.  Rolling that back swaps the text of the record with the text of
+ * the line, so the record now holds the line after the change, and is a
+ * LOG_LINE_SWAP_F record, which rolling forward swaps back.  The range
+ * record is rewritten each time it's rolled.  A swap record that has
+ * already been rolled in the direction it's being rolled is left alone,
+ * which keeps 'U' working when it only resets some of the lines.  A
+ * LOG_LINE_MOVE record holds the first and last lines of a set of lines
+ * that were moved, and the line they were moved after.  It's rolled back
+ * by moving the lines back, so the text of the lines isn't logged.
+ *
  * The 'U' command is implemented by rolling backward to a LOG_CURSOR_END
  * record for a line different from the current one.  It should be noted that
  * this means that a subsequent 'u' command will make a change based on the
@@ -69,7 +88,13 @@
  * behaved that way.
  */
 
+static int      log_back1(SCR *, unsigned char *, size_t, int *, LRANGE *);
 static int      log_cursor1(SCR *, int);
+static int      log_forw1(SCR *, unsigned char *, size_t, int *, LRANGE *);
+static int      log_range1(SCR *, unsigned char *, size_t, int, int (*)
+                    (SCR *, unsigned char *, size_t, int *, LRANGE *), int *);
+static int      log_set1(SCR *, unsigned char *, size_t, int *, LRANGE *);
+static int      log_swap1(SCR *, unsigned char *, size_t, LRANGE *);
 static void     log_err(SCR *, char *, int);
 
 /* Try and restart the log on failure, i.e. if we run out of memory. */
@@ -290,6 +315,7 @@ log_mark(SCR *sp, LMARK *lmp)
 {
         DBT data, key;
         EXF *ep;
+        LMARK lm;
 
         ep = sp->ep;
         if (F_ISSET(ep, F_NOLOG))
@@ -305,7 +331,9 @@ log_mark(SCR *sp, LMARK *lmp)
         BINC_RET(sp, ep->l_lp,
             ep->l_len, sizeof(unsigned char) + sizeof(LMARK));
         ep->l_lp[0] = LOG_MARK;
-        memmove(ep->l_lp + sizeof(unsigned char), lmp, sizeof(LMARK));
+        lm = *lmp;
+        lm.lno = mark_lno(sp, lmp);
+        memmove(ep->l_lp + sizeof(unsigned char), &lm, sizeof(LMARK));
 
         key.data = &ep->l_cur;
         key.size = sizeof(recno_t);
@@ -319,6 +347,112 @@ log_mark(SCR *sp, LMARK *lmp)
         return (0);
 }
 
+/*
+ * log_move --
+ *      Log moving lines fl through ll to after line tl.
+ *
+ * PUBLIC: int log_move(SCR *, recno_t, recno_t, recno_t);
+ */
+
+int
+log_move(SCR *sp, recno_t fl, recno_t ll, recno_t tl)
+{
+        DBT data, key;
+        EXF *ep;
+        unsigned char *p;
+
+        ep = sp->ep;
+        if (F_ISSET(ep, F_NOLOG))
+                return (0);
+
+        /* See log_line. */
+        F_CLR(ep, F_UNDO);
+
+        /* Put out one initial cursor record per set of changes. */
+        if (ep->l_cursor.lno != OOBLNO) {
+                if (log_cursor1(sp, LOG_CURSOR_INIT))
+                        return (1);
+                ep->l_cursor.lno = OOBLNO;
+        }
+
+        BINC_RET(sp,
+            ep->l_lp, ep->l_len, sizeof(unsigned char) + 3 * sizeof(recno_t));
+        p = (unsigned char *)ep->l_lp;
+        *p++ = LOG_LINE_MOVE;
+        memmove(p, &fl, sizeof(recno_t));
+        memmove(p + sizeof(recno_t), &ll, sizeof(recno_t));
+        memmove(p + 2 * sizeof(recno_t), &tl, sizeof(recno_t));
+
+        key.data = &ep->l_cur;
+        key.size = sizeof(recno_t);
+        data.data = ep->l_lp;
+        data.size = sizeof(unsigned char) + 3 * sizeof(recno_t);
+        if (ep->log->put(ep->log, &key, &data, 0) == -1)
+                LOG_ERR;
+
+        /* Reset high water mark. */
+        ep->l_high = ++ep->l_cur;
+        return (0);
+}
+
+/*
+ * log_range --
+ *      Log a set of line changes applied together.  Only the line before
+ *      each reset is logged, as a LOG_LINE_SWAP_B record.
+ *
+ * PUBLIC: int log_range(SCR *, LRANGE *);
+ */
+
+int
+log_range(SCR *sp, LRANGE *rp)
+{
+        DBT data, key;
+        EXF *ep;
+        size_t from, len, n, to;
+
+        ep = sp->ep;
+        if (F_ISSET(ep, F_NOLOG) || rp->cnt == 0)
+                return (0);
+
+        for (from = to = sizeof(unsigned char); from < rp->len; from += n) {
+                memmove(&len, rp->bp + from, sizeof(size_t));
+                n = len + 2 * sizeof(size_t);
+                switch (rp->bp[from + sizeof(size_t)]) {
+                case LOG_LINE_RESET_B:
+                        rp->bp[from + sizeof(size_t)] = LOG_LINE_SWAP_B;
+                        break;
+                case LOG_LINE_RESET_F:
+                        continue;
+                }
+                if (to != from)
+                        memmove(rp->bp + to, rp->bp + from, n);
+                to += n;
+        }
+        rp->len = to;
+
+        /* See log_line. */
+        F_CLR(ep, F_UNDO);
+
+        /* Put out one initial cursor record per set of changes. */
+        if (ep->l_cursor.lno != OOBLNO) {
+                if (log_cursor1(sp, LOG_CURSOR_INIT))
+                        return (1);
+                ep->l_cursor.lno = OOBLNO;
+        }
+
+        rp->bp[0] = LOG_LINE_RANGE;
+        key.data = &ep->l_cur;
+        key.size = sizeof(recno_t);
+        data.data = rp->bp;
+        data.size = rp->len;
+        if (ep->log->put(ep->log, &key, &data, 0) == -1)
+                LOG_ERR;
+
+        /* Reset high water mark. */
+        ep->l_high = ++ep->l_cur;
+        return (0);
+}
+
 /*
  * Log_backward --
  *      Roll the log backward one operation.
@@ -333,7 +467,6 @@ log_backward(SCR *sp, MARK *rp)
         EXF *ep;
         LMARK lm;
         MARK m;
-        recno_t lno;
         int didop;
         unsigned char *p;
 
@@ -369,34 +502,17 @@ log_backward(SCR *sp, MARK *rp)
                         break;
                 case LOG_LINE_APPEND:
                 case LOG_LINE_INSERT:
-                        didop = 1;
-                        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
-                        if (db_delete(sp, lno))
-                                goto err;
-                        ++sp->rptlines[L_DELETED];
-                        break;
                 case LOG_LINE_DELETE:
-                        didop = 1;
-                        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
-                        if (db_insert(sp, lno, p + sizeof(unsigned char) +
-                            sizeof(recno_t), data.size - sizeof(unsigned char) -
-                            sizeof(recno_t)))
-                                goto err;
-                        ++sp->rptlines[L_ADDED];
-                        break;
                 case LOG_LINE_RESET_F:
-                        break;
                 case LOG_LINE_RESET_B:
-                        didop = 1;
-                        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
-                        if (db_set(sp, lno, p + sizeof(unsigned char) +
-                            sizeof(recno_t), data.size - sizeof(unsigned char) -
-                            sizeof(recno_t)))
+                case LOG_LINE_MOVE:
+                        if (log_back1(sp, p, data.size, &didop, NULL))
+                                goto err;
+                        break;
+                case LOG_LINE_RANGE:
+                        if (log_range1(sp,
+                            p, data.size, 1, log_back1, &didop))
                                 goto err;
-                        if (sp->rptlchange != lno) {
-                                sp->rptlchange = lno;
-                                ++sp->rptlines[L_CHANGED];
-                        }
                         break;
                 case LOG_MARK:
                         didop = 1;
@@ -435,7 +551,6 @@ log_setline(SCR *sp)
         EXF *ep;
         LMARK lm;
         MARK m;
-        recno_t lno;
         unsigned char *p;
 
         ep = sp->ep;
@@ -477,18 +592,14 @@ log_setline(SCR *sp)
                 case LOG_LINE_INSERT:
                 case LOG_LINE_DELETE:
                 case LOG_LINE_RESET_F:
-                        break;
                 case LOG_LINE_RESET_B:
-                        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
-                        if (lno == sp->lno &&
-                            db_set(sp, lno, p + sizeof(unsigned char) +
-                            sizeof(recno_t), data.size - sizeof(unsigned char) -
-                            sizeof(recno_t)))
+                case LOG_LINE_MOVE:
+                        if (log_set1(sp, p, data.size, NULL, NULL))
+                                goto err;
+                        break;
+                case LOG_LINE_RANGE:
+                        if (log_range1(sp, p, data.size, 1, log_set1, NULL))
                                 goto err;
-                        if (sp->rptlchange != lno) {
-                                sp->rptlchange = lno;
-                                ++sp->rptlines[L_CHANGED];
-                        }
                         break;
                 case LOG_MARK:
                         memmove(&lm, p + sizeof(unsigned char), sizeof(LMARK));
@@ -520,7 +631,6 @@ log_forward(SCR *sp, MARK *rp)
         EXF *ep;
         LMARK lm;
         MARK m;
-        recno_t lno;
         int didop;
         unsigned char *p;
 
@@ -557,34 +667,17 @@ log_forward(SCR *sp, MARK *rp)
                         break;
                 case LOG_LINE_APPEND:
                 case LOG_LINE_INSERT:
-                        didop = 1;
-                        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
-                        if (db_insert(sp, lno, p + sizeof(unsigned char) +
-                            sizeof(recno_t), data.size - sizeof(unsigned char) -
-                            sizeof(recno_t)))
-                                goto err;
-                        ++sp->rptlines[L_ADDED];
-                        break;
                 case LOG_LINE_DELETE:
-                        didop = 1;
-                        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
-                        if (db_delete(sp, lno))
-                                goto err;
-                        ++sp->rptlines[L_DELETED];
-                        break;
                 case LOG_LINE_RESET_B:
-                        break;
                 case LOG_LINE_RESET_F:
-                        didop = 1;
-                        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
-                        if (db_set(sp, lno, p + sizeof(unsigned char) +
-                            sizeof(recno_t), data.size - sizeof(unsigned char) -
-                            sizeof(recno_t)))
+                case LOG_LINE_MOVE:
+                        if (log_forw1(sp, p, data.size, &didop, NULL))
+                                goto err;
+                        break;
+                case LOG_LINE_RANGE:
+                        if (log_range1(sp,
+                            p, data.size, 0, log_forw1, &didop))
                                 goto err;
-                        if (sp->rptlchange != lno) {
-                                sp->rptlchange = lno;
-                                ++sp->rptlines[L_CHANGED];
-                        }
                         break;
                 case LOG_MARK:
                         didop = 1;
@@ -603,6 +696,275 @@ err:    F_CLR(ep, F_NOLOG);
         return (1);
 }
 
+/*
+ * log_back1 --
+ *      Roll a line record backward.  A swap record is replaced in the range
+ *      record being rewritten, lrp.
+ */
+
+static int
+log_back1(SCR *sp, unsigned char *p, size_t size, int *didopp, LRANGE *lrp)
+{
+        recno_t cnt, ll, lno, tl;
+
+        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
+        switch (*p) {
+        case LOG_LINE_APPEND:
+        case LOG_LINE_INSERT:
+                *didopp = 1;
+                if (db_delete(sp, lno))
+                        return (1);
+                ++sp->rptlines[L_DELETED];
+                break;
+        case LOG_LINE_DELETE:
+                *didopp = 1;
+                if (db_insert(sp, lno, p + sizeof(unsigned char) +
+                    sizeof(recno_t), size - sizeof(unsigned char) -
+                    sizeof(recno_t)))
+                        return (1);
+                ++sp->rptlines[L_ADDED];
+                break;
+        case LOG_LINE_RESET_F:
+        case LOG_LINE_SWAP_F:
+                break;
+        case LOG_LINE_RESET_B:
+        case LOG_LINE_SWAP_B:
+                *didopp = 1;
+                if (*p == LOG_LINE_SWAP_B ? log_swap1(sp, p, size, lrp) :
+                    db_set(sp, lno, p + sizeof(unsigned char) +
+                    sizeof(recno_t), size - sizeof(unsigned char) -
+                    sizeof(recno_t)))
+                        return (1);
+                if (sp->rptlchange != lno) {
+                        sp->rptlchange = lno;
+                        ++sp->rptlines[L_CHANGED];
+                }
+                break;
+        case LOG_LINE_MOVE:
+                *didopp = 1;
+                memmove(&ll, p + sizeof(unsigned char) +
+                    sizeof(recno_t), sizeof(recno_t));
+                memmove(&tl, p + sizeof(unsigned char) +
+                    2 * sizeof(recno_t), sizeof(recno_t));
+                cnt = (ll - lno) + 1;
+                if (tl > ll ? db_move(sp, tl - cnt + 1, tl, lno - 1) :
+                    db_move(sp, tl + 1, tl + cnt, ll))
+                        return (1);
+                sp->rptlines[L_ADDED] += cnt;
+                sp->rptlines[L_DELETED] += cnt;
+                break;
+        default:
+                abort();
+        }
+        return (0);
+}
+
+/*
+ * log_set1 --
+ *      Reset the current line from a line record, for the 'U' command.
+ */
+
+static int
+log_set1(SCR *sp, unsigned char *p, size_t size, int *didopp, LRANGE *lrp)
+{
+        recno_t lno;
+
+        (void)didopp;
+        if (*p != LOG_LINE_RESET_B && *p != LOG_LINE_SWAP_B)
+                return (0);
+        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
+        if (lno == sp->lno && (*p == LOG_LINE_SWAP_B ?
+            log_swap1(sp, p, size, lrp) :
+            db_set(sp, lno, p + sizeof(unsigned char) +
+            sizeof(recno_t), size - sizeof(unsigned char) -
+            sizeof(recno_t))))
+                return (1);
+        if (sp->rptlchange != lno) {
+                sp->rptlchange = lno;
+                ++sp->rptlines[L_CHANGED];
+        }
+        return (0);
+}
+
+/*
+ * log_forw1 --
+ *      Roll a line record forward.  A swap record is replaced in the range
+ *      record being rewritten, lrp.
+ */
+
+static int
+log_forw1(SCR *sp, unsigned char *p, size_t size, int *didopp, LRANGE *lrp)
+{
+        recno_t cnt, ll, lno, tl;
+
+        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
+        switch (*p) {
+        case LOG_LINE_APPEND:
+        case LOG_LINE_INSERT:
+                *didopp = 1;
+                if (db_insert(sp, lno, p + sizeof(unsigned char) +
+                    sizeof(recno_t), size - sizeof(unsigned char) -
+                    sizeof(recno_t)))
+                        return (1);
+                ++sp->rptlines[L_ADDED];
+                break;
+        case LOG_LINE_DELETE:
+                *didopp = 1;
+                if (db_delete(sp, lno))
+                        return (1);
+                ++sp->rptlines[L_DELETED];
+                break;
+        case LOG_LINE_RESET_B:
+        case LOG_LINE_SWAP_B:
+                break;
+        case LOG_LINE_RESET_F:
+        case LOG_LINE_SWAP_F:
+                *didopp = 1;
+                if (*p == LOG_LINE_SWAP_F ? log_swap1(sp, p, size, lrp) :
+                    db_set(sp, lno, p + sizeof(unsigned char) +
+                    sizeof(recno_t), size - sizeof(unsigned char) -
+                    sizeof(recno_t)))
+                        return (1);
+                if (sp->rptlchange != lno) {
+                        sp->rptlchange = lno;
+                        ++sp->rptlines[L_CHANGED];
+                }
+                break;
+        case LOG_LINE_MOVE:
+                *didopp = 1;
+                memmove(&ll, p + sizeof(unsigned char) +
+                    sizeof(recno_t), sizeof(recno_t));
+                memmove(&tl, p + sizeof(unsigned char) +
+                    2 * sizeof(recno_t), sizeof(recno_t));
+                cnt = (ll - lno) + 1;
+                if (db_move(sp, lno, ll, tl))
+                        return (1);
+                sp->rptlines[L_ADDED] += cnt;
+                sp->rptlines[L_DELETED] += cnt;
+                break;
+        default:
+                abort();
+        }
+        return (0);
+}
+
+/*
+ * log_range1 --
+ *      Roll the line records of a LOG_LINE_RANGE record, from the last
+ *      one back to the first if backward is set, else from the first.  If
+ *      any swap records were rolled, the record is rewritten.
+ */
+
+static int
+log_range1(SCR *sp, unsigned char *p, size_t size, int backward,
+    int (*fn)(SCR *, unsigned char *, size_t, int *, LRANGE *), int *didopp)
+{
+        DBT data, key;
+        EXF *ep;
+        LRANGE r;
+        recno_t lno;
+        size_t len, n, off, olen, to;
+        int rval, swapped;
+        unsigned char *endp, *lp;
+        char *bp;
+
+        ep = sp->ep;
+        memset(&r, 0, sizeof(LRANGE));
+        rval = swapped = 0;
+        endp = p + size;
+        for (p += sizeof(unsigned char); p < endp;) {
+                if (backward) {
+                        memmove(&len, endp - sizeof(size_t), sizeof(size_t));
+                        endp -= len + 2 * sizeof(size_t);
+                        lp = endp + sizeof(size_t);
+                } else {
+                        memmove(&len, p, sizeof(size_t));
+                        lp = p + sizeof(size_t);
+                        p += len + 2 * sizeof(size_t);
+                }
+
+                /* Once a record fails, copy the rest as they are. */
+                olen = r.len;
+                if (!rval && fn(sp, lp, len, didopp, &r))
+                        rval = 1;
+                if (r.len != olen) {
+                        swapped = 1;
+                        continue;
+                }
+                memmove(&lno, lp + sizeof(unsigned char), sizeof(recno_t));
+                if (db_radd(sp, &r, lno, *lp,
+                    (char *)lp + sizeof(unsigned char) + sizeof(recno_t),
+                    len - sizeof(unsigned char) - sizeof(recno_t))) {
+                        db_rfree(&r);
+                        LOG_ERR;
+                }
+        }
+        if (!swapped) {
+                db_rfree(&r);
+                return (rval);
+        }
+
+        /* Rolling backward added the records in reverse order. */
+        bp = r.bp;
+        if (backward) {
+                MALLOC(sp, bp, r.len);
+                if (bp == NULL) {
+                        db_rfree(&r);
+                        LOG_ERR;
+                }
+                for (off = r.len, to = sizeof(unsigned char);
+                    off > sizeof(unsigned char); to += n) {
+                        memmove(&len,
+                            r.bp + off - sizeof(size_t), sizeof(size_t));
+                        n = len + 2 * sizeof(size_t);
+                        off -= n;
+                        memmove(bp + to, r.bp + off, n);
+                }
+        }
+        bp[0] = LOG_LINE_RANGE;
+        key.data = &ep->l_cur;
+        key.size = sizeof(recno_t);
+        data.data = bp;
+        data.size = r.len;
+        if (ep->log->put(ep->log, &key, &data, 0) == -1) {
+                if (bp != r.bp)
+                        free(bp);
+                db_rfree(&r);
+                LOG_ERR;
+        }
+        if (bp != r.bp)
+                free(bp);
+        db_rfree(&r);
+        return (rval);
+}
+
+/*
+ * log_swap1 --
+ *      Swap the text of a line with the text of a LOG_LINE_SWAP record,
+ *      and add the swapped record to the range record being rewritten.
+ */
+
+static int
+log_swap1(SCR *sp, unsigned char *p, size_t size, LRANGE *lrp)
+{
+        recno_t lno;
+        size_t len, olen;
+        char *lp;
+
+        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
+        if (db_get(sp, lno, DBG_FATAL | DBG_NOCACHE, &lp, &len))
+                return (1);
+        olen = lrp->len;
+        if (db_radd(sp, lrp, lno, *p == LOG_LINE_SWAP_B ?
+            LOG_LINE_SWAP_F : LOG_LINE_SWAP_B, lp, len) ||
+            db_set(sp, lno, (char *)p + sizeof(unsigned char) +
+            sizeof(recno_t), size - sizeof(unsigned char) - sizeof(recno_t))) {
+                lrp->len = olen;
+                return (1);
+        }
+        return (0);
+}
+
 /*
  * log_err --
  *      Try and restart the log on failure, i.e. if we run out of memory.
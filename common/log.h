@@ -23,3 +23,26 @@
 #define LOG_LINE_RESET_F        6
 #define LOG_LINE_RESET_B        7
 #define LOG_MARK                8
+#define LOG_LINE_RANGE          9
+#define LOG_LINE_MOVE           10
+#define LOG_LINE_SWAP_B         11
+#define LOG_LINE_SWAP_F         12
+
+/*
+ * Commands that change many lines stage the changes in an LRANGE, and
+ * then apply them together.  The buffer is the LOG_LINE_RANGE record for
+ * the changes: after the type byte, each change is a LOG_LINE_DELETE,
+ * LOG_LINE_RESET_B or LOG_LINE_RESET_F record, with its length before
+ * and after it so that the changes can be rolled in either direction.
+ * When the record is logged, each pair of LOG_LINE_RESET records becomes
+ * a single LOG_LINE_SWAP record, see log.c.
+ */
+#define LRANGE_MAX      (1024 * 1024)   /* Bytes staged before applying. */
+
+typedef struct _lrange LRANGE;
+struct _lrange {
+        char    *bp;                    /* Log record.              */
+        size_t   blen;                  /* Log record buffer size.  */
+        size_t   len;                   /* Log record length.       */
+        size_t   cnt;                   /* Number of staged changes. */
+};
@@ -25,6 +25,10 @@
 #include "common.h"
 
 static LMARK *mark_find(SCR *, CHAR_T);
+static int    mark_index(SCR *, EXF *);
+static size_t mark_lower(EXF *, recno_t);
+static long   mark_delta(EXF *, size_t);
+static void   mark_shift(EXF *, size_t, long);
 
 /*
  * Marks are maintained in a key sorted doubly linked list.  We can't
@@ -32,6 +36,17 @@ static LMARK *mark_find(SCR *, CHAR_T);
  * The underlying assumption is that users don't have more than, say,
  * 10 marks at any one time, so this will be is fast enough.
  *
+ * Line insertions and deletions are another matter, they happen once per
+ * line for every change to the file.  So, the marks are also kept in an
+ * array sorted by line number, and the line number stored in the mark is
+ * the value it had when the array was last sorted.  Insertions and deletions
+ * don't walk the marks, they add a delta to every mark from some array
+ * offset on, which is kept in a Fenwick (binary indexed) tree.  The real
+ * line number of a mark is the stored value plus the sum of the deltas at
+ * its offset, see mark_lno().  Because every change shifts a suffix of the
+ * array by the same amount, the array stays sorted until a mark is moved.
+ * Setting a mark folds the deltas back into the marks and re-sorts.
+ *
  * Marks are fixed, and modifications to the line don't update the mark's
  * position in the line.  This can be hard.  If you add text to the line,
  * place a mark in that text, undo the addition and use ` to move to the
@@ -76,6 +91,9 @@ mark_init(SCR *sp, EXF *ep)
          */
 
         LIST_INIT(&ep->marks);
+        ep->m_ord = NULL;
+        ep->m_fen = NULL;
+        ep->m_cnt = ep->m_max = 0;
         return (0);
 }
 
@@ -100,6 +118,11 @@ mark_end(SCR *sp, EXF *ep)
                 LIST_REMOVE(lmp, q);
                 free(lmp);
         }
+        free(ep->m_ord);
+        free(ep->m_fen);
+        ep->m_ord = NULL;
+        ep->m_fen = NULL;
+        ep->m_cnt = ep->m_max = 0;
         return (0);
 }
 
@@ -135,13 +158,13 @@ mark_get(SCR *sp, CHAR_T key, MARK *mp, mtype_t mtype)
          * you could use it in an empty file.  Make such a mark always work.
          */
 
-        if ((lmp->lno != 1 || lmp->cno != 0) && !db_exist(sp, lmp->lno)) {
+        mp->lno = mark_lno(sp, lmp);
+        if ((mp->lno != 1 || lmp->cno != 0) && !db_exist(sp, mp->lno)) {
                 msgq(sp, mtype,
                     "Mark %s: cursor position no longer exists",
                     KEY_NAME(sp, key));
                 return (1);
         }
-        mp->lno = lmp->lno;
         mp->cno = lmp->cno;
         return (0);
 }
@@ -157,6 +180,7 @@ int
 mark_set(SCR *sp, CHAR_T key, MARK *value, int userset)
 {
         LMARK *lmp, *lmt;
+        int isnew;
 
         if (key == ABSMARK2)
                 key = ABSMARK1;
@@ -169,7 +193,7 @@ mark_set(SCR *sp, CHAR_T key, MARK *value, int userset)
          */
 
         lmp = mark_find(sp, key);
-        if (lmp == NULL || lmp->name != key) {
+        if ((isnew = lmp == NULL || lmp->name != key)) {
                 MALLOC_RET(sp, lmt, sizeof(LMARK));
                 if (lmp == NULL) {
                         LIST_INSERT_HEAD(&sp->ep->marks, lmt, q);
@@ -180,13 +204,163 @@ mark_set(SCR *sp, CHAR_T key, MARK *value, int userset)
             !F_ISSET(lmp, MARK_DELETED) && F_ISSET(lmp, MARK_USERSET))
                 return (0);
 
-        lmp->lno = value->lno;
         lmp->cno = value->cno;
         lmp->name = key;
         lmp->flags = userset ? MARK_USERSET : 0;
+        if (!isnew && mark_lno(sp, lmp) == value->lno)
+                return (0);
+        return (mark_setlno(sp, lmp, value->lno));
+}
+
+/*
+ * mark_lno --
+ *      Return the current line number of a mark.
+ *
+ * PUBLIC: recno_t mark_lno(SCR *, LMARK *);
+ */
+
+recno_t
+mark_lno(SCR *sp, LMARK *lmp)
+{
+        return (lmp->lno + mark_delta(sp->ep, lmp->idx));
+}
+
+/*
+ * mark_setlno --
+ *      Move a mark to a new line.
+ *
+ * PUBLIC: int mark_setlno(SCR *, LMARK *, recno_t);
+ */
+
+int
+mark_setlno(SCR *sp, LMARK *lmp, recno_t lno)
+{
+        EXF *ep;
+        size_t i;
+
+        /*
+         * Fold the pending deltas into the marks, so the stored line
+         * numbers are real ones, move the mark and rebuild the index.
+         * New marks aren't in the index yet, and have no deltas.
+         */
+
+        ep = sp->ep;
+        for (i = 0; i < ep->m_cnt; ++i)
+                ep->m_ord[i]->lno = mark_lno(sp, ep->m_ord[i]);
+        lmp->lno = lno;
+        return (mark_index(sp, ep));
+}
+
+/*
+ * mark_cmp --
+ *      Compare two marks by line number, for qsort(3).
+ */
+
+static int
+mark_cmp(const void *a, const void *b)
+{
+        recno_t alno, blno;
+
+        alno = (*(LMARK * const *)a)->lno;
+        blno = (*(LMARK * const *)b)->lno;
+        return (alno < blno ? -1 : alno > blno);
+}
+
+/*
+ * mark_index --
+ *      Rebuild the line ordered mark array, and clear the deltas.  The
+ *      line numbers stored in the marks must be current.  If there's no
+ *      memory for the array, mark_insdel() updates the marks one by one
+ *      until a later rebuild succeeds.
+ */
+
+static int
+mark_index(SCR *sp, EXF *ep)
+{
+        LMARK *lmp;
+        size_t cnt, i;
+
+        cnt = 0;
+        LIST_FOREACH(lmp, &ep->marks, q)
+                ++cnt;
+        if (cnt > ep->m_max) {
+                REALLOCARRAY(sp, ep->m_ord, cnt, sizeof(LMARK *));
+                REALLOCARRAY(sp, ep->m_fen, cnt + 1, sizeof(long));
+                if (ep->m_ord == NULL || ep->m_fen == NULL) {
+                        free(ep->m_ord);
+                        free(ep->m_fen);
+                        ep->m_ord = NULL;
+                        ep->m_fen = NULL;
+                        ep->m_cnt = ep->m_max = 0;
+                        LIST_FOREACH(lmp, &ep->marks, q)
+                                lmp->idx = 0;
+                        return (1);
+                }
+                ep->m_max = cnt;
+        }
+
+        i = 0;
+        LIST_FOREACH(lmp, &ep->marks, q)
+                ep->m_ord[i++] = lmp;
+        qsort(ep->m_ord, cnt, sizeof(LMARK *), mark_cmp);
+        for (i = 0; i < cnt; ++i)
+                ep->m_ord[i]->idx = i;
+        memset(ep->m_fen, 0, (cnt + 1) * sizeof(long));
+        ep->m_cnt = cnt;
         return (0);
 }
 
+/*
+ * mark_delta --
+ *      Return the sum of the line deltas at an index offset.
+ */
+
+static long
+mark_delta(EXF *ep, size_t i)
+{
+        long delta;
+
+        if (i >= ep->m_cnt)
+                return (0);
+        for (delta = 0, ++i; i > 0; i -= i & -i)
+                delta += ep->m_fen[i];
+        return (delta);
+}
+
+/*
+ * mark_shift --
+ *      Add a line delta to all marks from an index offset on.
+ */
+
+static void
+mark_shift(EXF *ep, size_t i, long delta)
+{
+        for (++i; i <= ep->m_cnt; i += i & -i)
+                ep->m_fen[i] += delta;
+}
+
+/*
+ * mark_lower --
+ *      Return the index offset of the first mark at or after a line.
+ */
+
+static size_t
+mark_lower(EXF *ep, recno_t lno)
+{
+        size_t hi, lo, mid;
+        LMARK *lmp;
+
+        for (lo = 0, hi = ep->m_cnt; lo < hi;) {
+                mid = lo + (hi - lo) / 2;
+                lmp = ep->m_ord[mid];
+                if ((recno_t)(lmp->lno + mark_delta(ep, mid)) < lno)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+        return (lo);
+}
+
 /*
  * mark_find --
  *      Find the requested mark, or, the slot immediately before
@@ -220,22 +394,37 @@ mark_find(SCR *sp, CHAR_T key)
 int
 mark_insdel(SCR *sp, lnop_t op, recno_t lno)
 {
+        EXF *ep;
         LMARK *lmp;
         recno_t lline;
+        size_t i;
 
+        ep = sp->ep;
         switch (op) {
         case LINE_APPEND:
                 /* All insert/append operations are done as inserts. */
                 abort();
         case LINE_DELETE:
-                LIST_FOREACH(lmp, &sp->ep->marks, q)
-                        if (lmp->lno >= lno) {
-                                if (lmp->lno == lno) {
-                                        F_SET(lmp, MARK_DELETED);
-                                        (void)log_mark(sp, lmp);
-                                } else
-                                        --lmp->lno;
-                        }
+                if (ep->m_ord == NULL) {
+                        LIST_FOREACH(lmp, &ep->marks, q)
+                                if (lmp->lno >= lno) {
+                                        if (lmp->lno == lno) {
+                                                F_SET(lmp, MARK_DELETED);
+                                                (void)log_mark(sp, lmp);
+                                        } else
+                                                --lmp->lno;
+                                }
+                        break;
+                }
+                for (i = mark_lower(ep, lno); i < ep->m_cnt; ++i) {
+                        lmp = ep->m_ord[i];
+                        if (mark_lno(sp, lmp) != lno)
+                                break;
+                        F_SET(lmp, MARK_DELETED);
+                        (void)log_mark(sp, lmp);
+                }
+                if (i < ep->m_cnt)
+                        mark_shift(ep, i, -1);
                 break;
         case LINE_INSERT:
 
@@ -261,9 +450,12 @@ mark_insdel(SCR *sp, lnop_t op, recno_t lno)
                                 return (0);
                 }
 
-                LIST_FOREACH(lmp, &sp->ep->marks, q)
-                        if (lmp->lno >= lno)
-                                ++lmp->lno;
+                if (ep->m_ord == NULL) {
+                        LIST_FOREACH(lmp, &ep->marks, q)
+                                if (lmp->lno >= lno)
+                                        ++lmp->lno;
+                } else if ((i = mark_lower(ep, lno)) < ep->m_cnt)
+                        mark_shift(ep, i, 1);
                 break;
         case LINE_RESET:
                 break;
@@ -35,8 +35,9 @@ struct _mark {
 
 struct _lmark {
         LIST_ENTRY(_lmark) q;           /* Linked list of marks. */
-        recno_t  lno;                   /* Line number.          */
+        recno_t  lno;                   /* Line number, see mark.c. */
         size_t   cno;                   /* Column number.        */
+        size_t   idx;                   /* Line order index.     */
         CHAR_T   name;                  /* Mark name.            */
 
 #define MARK_DELETED    0x01            /* Mark was deleted.   */
@@ -147,6 +147,8 @@ OPTLIST const optlist[] = {
         {"ruler",       NULL,           OPT_0BOOL,      0},
 /* O_SCROLL         4BSD */
         {"scroll",      NULL,           OPT_NUM,        0},
+/* O_SEARCHCOUNT   OpenVi */
+        {"searchcount", NULL,           OPT_0BOOL,      0},
 /* O_SEARCHINCR   4.4BSD */
         {"searchincr",  NULL,           OPT_0BOOL,      0},
 /* O_SECTIONS       4BSD */
@@ -122,6 +122,7 @@ struct _scr {
         regex_t  re_c;                  /* Search RE: compiled form. */
         char    *re;                    /* Search RE: uncompiled form. */
         size_t   re_len;                /* Search RE: uncompiled length. */
+        SINDEX  *sidx;                  /* Search RE: matching line index. */
         regex_t  subre_c;               /* Substitute RE: compiled form. */
         char    *subre;                 /* Substitute RE: uncompiled form. */
         size_t   subre_len;             /* Substitute RE: uncompiled length). */
@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdio.h>
+#include <time.h>
 #include <bsd_stdlib.h>
 #include <bsd_string.h>
 #include <bsd_unistd.h>
@@ -28,8 +29,83 @@
 
 typedef enum { S_EMPTY, S_EOF, S_NOPREV, S_NOTFOUND, S_SOF, S_WRAP } smsg_t;
 
+/* Parallel search state, shared with the searching threads. */
+typedef struct {
+        LBATCH   b;                             /* Lines being searched. */
+        regex_t *re;                            /* Compiled RE.          */
+        dir_t    dir;                           /* Search direction.     */
+        size_t   hit[THREAD_BATCH / THREAD_UNIT];       /* Unit matches. */
+} SSKIP;
+
+#define SEARCH_SKIP     128             /* Lines in the first skip batch. */
+
+/*
+ * The match index is the sorted list of lines that match the search RE.  It
+ * is built a batch at a time while vi waits for the user to type, and once
+ * it's complete, searches look up the next matching line instead of reading
+ * the file.  The batches are sized to take about SINDEX_IMSEC milliseconds,
+ * so a key typed during one usually waits no longer than that; a batch that
+ * has to read the lines from disk, or holds a very long line, can take more.
+ *
+ * Changes to the file are logged as they happen, a run of changes to
+ * neighboring lines as one entry.  When the log fills, or the index is next
+ * used, the log is merged into the index: the indexed lines are renumbered,
+ * and the changed lines are kept as ranges to search.  They are searched a
+ * batch at a time while vi waits, or all at once when the index is used, so
+ * only the lines that changed are ever searched again.
+ */
+#define SINDEX_LOG      128             /* Changes logged before a merge. */
+#define SINDEX_ILINES   64              /* Lines in the first idle batch. */
+#define SINDEX_IMSEC    5               /* Milliseconds per idle batch. */
+
+typedef struct {                        /* Lines lno to lno + cnt - 1. */
+        recno_t  lno;
+        recno_t  cnt;
+} SRANGE;
+
+struct _sindex {
+        EXF     *ep;                    /* File being indexed. */
+        recno_t *lno;                   /* Matching lines, ascending. */
+        size_t   cnt;                   /* Matching lines. */
+        size_t   max;                   /* Matching lines allocated. */
+        recno_t  next;                  /* First line not yet indexed. */
+        recno_t  ilines;                /* Lines in the next idle batch. */
+        int      done;                  /* All lines indexed. */
+
+        SRANGE  *dirty;                 /* Changed lines, ascending. */
+        size_t   ndirty;                /* Changed line ranges. */
+
+        struct {                        /* Changes not yet merged. */
+                lnop_t   op;
+                recno_t  lno;
+                recno_t  cnt;
+        } log[SINDEX_LOG];
+        size_t   nlog;
+};
+
+/* Match index batch state, shared with the indexing threads. */
+typedef struct {
+        LBATCH   b;                             /* Lines being indexed.  */
+        regex_t *re;                            /* Compiled RE.          */
+        char     hit[THREAD_BATCH];             /* Line matches.         */
+} SBUILD;
+
+static int      search_ifind(SCR *, dir_t, recno_t *, recno_t);
+static void     search_ilog(SCR *, EXF *, lnop_t, recno_t);
+static size_t   search_ilower(SINDEX *, recno_t);
+static void     search_iadd(SRANGE *, size_t *, recno_t, recno_t);
+static int      search_imerge(SCR *, SINDEX *);
+static int      search_iscan(SCR *, SINDEX *, recno_t);
+static size_t   search_isplit(SRANGE *, size_t *, recno_t);
+static void     search_istart(SINDEX *);
+static SINDEX  *search_isync(SCR *, recno_t);
+static void     search_itime(SINDEX *, struct timespec *, int);
+static int      search_iunit(void *, size_t);
 static void     search_msg(SCR *, smsg_t);
 static int      search_init(SCR *, dir_t, char *, size_t, char **, unsigned int);
+static int      search_skip(SCR *, dir_t, recno_t *, recno_t, busy_t *,
+                    unsigned int);
+static int      search_unit(void *, size_t);
 
 /*
  * search_init --
@@ -151,7 +227,7 @@ f_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
     unsigned int flags)
 {
         busy_t btype;
-        recno_t lno;
+        recno_t elno, lno;
         regmatch_t match[1];
         size_t coff, len;
         int cnt, eval, rval, wrapped = 0;
@@ -159,6 +235,8 @@ f_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
 
         if (search_init(sp, FORWARD, ptrn, plen, eptrn, flags))
                 return (1);
+        if (db_last(sp, &elno))
+                return (1);
 
         if (LF_ISSET(SEARCH_FILE)) {
                 lno = 1;
@@ -211,6 +289,9 @@ f_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
                         }
                         cnt = INTERRUPT_CHECK;
                 }
+                if (coff == 0 && search_skip(sp, FORWARD,
+                    &lno, wrapped ? fm->lno : elno, &btype, flags))
+                        break;
                 if ((wrapped && lno > fm->lno) || db_get(sp, lno, 0, &l, &len)) {
                         if (wrapped) {
                                 if (LF_ISSET(SEARCH_MSG))
@@ -356,16 +437,41 @@ b_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
                         continue;
                 }
 
+                if (coff == 0) {
+                        if (search_skip(sp, BACKWARD,
+                            &lno, wrapped ? fm->lno : 1, &btype, flags))
+                                break;
+                        if ((wrapped && lno < fm->lno) || lno == 0) {
+                                ++lno;
+                                continue;
+                        }
+                }
+
                 if (db_get(sp, lno, 0, &l, &len))
                         break;
 
-                /* Set the termination. */
+                /*
+                 * Find the last match on the line that starts before the
+                 * cursor, in one pass.  Historically the line was searched
+                 * again from each character in turn, which never tried the
+                 * end of the line itself; so an empty match there is only
+                 * used if no match starts on the last character.
+                 */
                 match[0].rm_so = 0;
                 match[0].rm_eo = len;
-
-                /* Search the line. */
-                eval = regexec(&sp->re_c, l, 1, match,
-                    (match[0].rm_eo == len ? 0 : REG_NOTEOL) | REG_STARTEND);
+                eval = regexec_last(&sp->re_c, l, 1, match, REG_STARTEND,
+                    coff != 0 ? (regoff_t)coff : (regoff_t)len + 1);
+                if (eval == 0 && coff == 0 &&
+                    len != 0 && match[0].rm_so == len) {
+                        match[0].rm_so = 0;
+                        match[0].rm_eo = len;
+                        if ((eval = regexec_last(&sp->re_c, l, 1, match,
+                            REG_STARTEND, (regoff_t)len)) == REG_NOMATCH ||
+                            (eval == 0 && match[0].rm_so != len - 1)) {
+                                match[0].rm_so = len;
+                                eval = 0;
+                        }
+                }
                 if (eval == REG_NOMATCH)
                         continue;
                 if (eval != 0) {
@@ -376,41 +482,11 @@ b_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
                         break;
                 }
 
-                /* Check for a match starting past the cursor. */
-                if (coff != 0 && match[0].rm_so >= coff)
-                        continue;
-
                 /* Warn if the search wrapped. */
                 if (wrapped && LF_ISSET(SEARCH_WMSG))
                         search_msg(sp, S_WRAP);
 
-                /*
-                 * We now have the first match on the line.  Step through the
-                 * line character by character until find the last acceptable
-                 * match.  This is painful, we need a better interface to regex
-                 * to make this work.
-                 */
-
-                for (;;) {
-                        last = match[0].rm_so++;
-                        if (match[0].rm_so >= len)
-                                break;
-                        match[0].rm_eo = len;
-                        eval = regexec(&sp->re_c, l, 1, match,
-                            (match[0].rm_so == 0 ? 0 : REG_NOTBOL) |
-                            REG_STARTEND);
-                        if (eval == REG_NOMATCH)
-                                break;
-                        if (eval != 0) {
-                                if (LF_ISSET(SEARCH_MSG))
-                                        re_error(sp, eval, &sp->re_c);
-                                else
-                                        (void)sp->gp->scr_bell(sp);
-                                goto err;
-                        }
-                        if (coff && match[0].rm_so >= coff)
-                                break;
-                }
+                last = match[0].rm_so;
                 rm->lno = lno;
 
                 /* See comment in f_search(). */
@@ -422,11 +498,692 @@ b_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
                 break;
         }
 
-err:    if (LF_ISSET(SEARCH_MSG))
+        if (LF_ISSET(SEARCH_MSG))
                 search_busy(sp, BUSY_OFF);
         return (rval);
 }
 
+/*
+ * search_skip --
+ *      Skip over whole lines that don't match, starting at *lnop and moving
+ *      in the search direction as far as elno.  The lines are copied out of
+ *      the file in batches that start small and grow, so near matches stay
+ *      cheap, and each batch is searched in parallel, taking the first match
+ *      in search order.  On return, *lnop is the first line that matched (or
+ *      that got an error from regexec, which the caller will repeat), or the
+ *      line past elno.  Returns 1 if interrupted or on error.
+ *
+ *      A complete match index answers without reading the file at all.
+ *      Otherwise, not worth doing if there's only one thread.
+ */
+
+static int
+search_skip(SCR *sp, dir_t dir, recno_t *lnop, recno_t elno, busy_t *btypep,
+    unsigned int flags)
+{
+        SSKIP ss;
+        recno_t hi, lo, lno, size;
+        size_t unit;
+        int rval;
+
+        lno = *lnop;
+        if (lno == 0 || (dir == FORWARD ? lno > elno : lno < elno) ||
+            search_ifind(sp, dir, lnop, elno) || thread_count() == 1)
+                return (0);
+
+        memset(&ss, 0, sizeof(ss));
+        ss.re = &sp->re_c;
+        ss.dir = dir;
+        for (rval = 0, size = SEARCH_SKIP;; size *= 2) {
+                if (size > THREAD_BATCH)
+                        size = THREAD_BATCH;
+                if (size > SEARCH_SKIP) {
+                        if (INTERRUPTED(sp)) {
+                                rval = 1;
+                                break;
+                        }
+                        if (LF_ISSET(SEARCH_MSG)) {
+                                search_busy(sp, *btypep);
+                                *btypep = BUSY_UPDATE;
+                        }
+                }
+
+                /*
+                 * Batches may be cut short if the lines are long, which
+                 * is fine going forward.  Going backward the batch has to
+                 * end at lno, so shrink it until it fits.
+                 */
+                if (dir == FORWARD) {
+                        lo = lno;
+                        hi = elno - lno < size ? elno : lno + size - 1;
+                } else {
+                        hi = lno;
+                        lo = lno - elno < size ? elno : lno - size + 1;
+                }
+                for (;;) {
+                        if (thread_batch(sp, &ss.b, lo, hi)) {
+                                rval = 1;
+                                goto done;
+                        }
+                        if (dir == FORWARD || ss.b.lno + ss.b.cnt > hi)
+                                break;
+                        lo = hi - ss.b.cnt + 1;
+                }
+
+                if ((unit = thread_first(LBATCH_UNITS(&ss.b),
+                    search_unit, &ss)) != LBATCH_UNITS(&ss.b)) {
+                        lno = ss.b.lno + ss.hit[unit];
+                        break;
+                }
+
+                /* Nothing in this batch, move on or give up. */
+                if (dir == FORWARD) {
+                        lno = ss.b.lno + ss.b.cnt;
+                        if (lno > elno)
+                                break;
+                } else {
+                        lno = ss.b.lno - 1;
+                        if (lno < elno)
+                                break;
+                }
+        }
+        *lnop = lno;
+done:   thread_bfree(&ss.b);
+        return (rval);
+}
+
+/*
+ * search_unit --
+ *      Search one work unit of a batch, in the search direction.  Backward
+ *      searches number the units from the end of the batch.
+ */
+
+static int
+search_unit(void *arg, size_t unit)
+{
+        SSKIP *ss;
+        size_t i, j, n;
+        int hit;
+
+        ss = arg;
+        i = unit * THREAD_UNIT;
+        n = i + THREAD_UNIT > ss->b.cnt ? ss->b.cnt - i : THREAD_UNIT;
+        if (ss->dir == BACKWARD)
+                i = ss->b.cnt - i - n;
+
+        /* Going backward, it's the last match in the unit. */
+        for (hit = 0; n > 0; ++i, --n) {
+                (void)regexec_lines(ss->re,
+                    ss->b.bp, ss->b.off + i, n, &j, 0);
+                if (j == n)
+                        break;
+                ss->hit[unit] = i += j;
+                n -= j;
+                hit = 1;
+                if (ss->dir == FORWARD)
+                        break;
+        }
+        return (hit);
+}
+
+/*
+ * search_index --
+ *      Note a successful vi search that ended on line lno.  Start a match
+ *      index for the search RE if there isn't one, and if the searchcount
+ *      option is set and the index is complete, report which of the matching
+ *      lines this is.
+ *
+ * PUBLIC: int search_index(SCR *, recno_t);
+ */
+
+int
+search_index(SCR *sp, recno_t lno)
+{
+        SINDEX *ix;
+        size_t i;
+
+        if (!F_ISSET(sp, SC_RE_SEARCH))
+                return (0);
+        if ((ix = sp->sidx) != NULL && ix->ep != sp->ep)
+                search_ifree(sp);
+        if (sp->sidx == NULL) {
+                CALLOC_RET(sp, sp->sidx, 1, sizeof(SINDEX));
+                sp->sidx->ep = sp->ep;
+                search_istart(sp->sidx);
+                return (0);
+        }
+
+        if (!O_ISSET(sp, O_SEARCHCOUNT) ||
+            (ix = search_isync(sp, MAX_REC_NUMBER)) == NULL || !ix->done)
+                return (0);
+        if ((i = search_ilower(ix, lno)) < ix->cnt && ix->lno[i] == lno)
+                msgq(sp, M_INFO, "Match %lu of %lu",
+                    (unsigned long)i + 1, (unsigned long)ix->cnt);
+        return (0);
+}
+
+/*
+ * search_idle --
+ *      Search the next batch of changed lines, or index the next batch of
+ *      lines, for the match index.  Returns 1 if there was work to do, and
+ *      it should be called again.
+ *
+ * PUBLIC: int search_idle(SCR *);
+ */
+
+int
+search_idle(SCR *sp)
+{
+        struct timespec ts;
+        SBUILD sb;
+        SINDEX *ix;
+        recno_t elno, last;
+        size_t i;
+
+        if (!F_ISSET(sp, SC_VI) || (ix = sp->sidx) == NULL)
+                return (0);
+        (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+        if (ix->nlog != 0 || ix->ndirty != 0) {
+                if ((ix = search_isync(sp, ix->ilines)) == NULL)
+                        return (0);
+                search_itime(ix, &ts, ix->ndirty != 0);
+                return (1);
+        }
+        if ((ix = search_isync(sp, 0)) == NULL || ix->done)
+                return (0);
+        if (db_last(sp, &elno)) {
+                search_ifree(sp);
+                return (0);
+        }
+        if (ix->next > elno) {
+                ix->done = 1;
+                return (0);
+        }
+
+        if ((last = ix->next + (ix->ilines - 1)) > elno || last < ix->next)
+                last = elno;
+        sb.b.bp = NULL;
+        sb.b.blen = 0;
+        sb.b.off = NULL;
+        sb.b.omax = 0;
+        sb.re = &sp->re_c;
+        if (thread_batch(sp, &sb.b, ix->next, last)) {
+                thread_bfree(&sb.b);
+                search_ifree(sp);
+                return (0);
+        }
+        thread_run(LBATCH_UNITS(&sb.b), search_iunit, &sb);
+        search_itime(ix, &ts, sb.b.cnt == ix->ilines);
+        for (i = 0; i < sb.b.cnt; ++i) {
+                if (!sb.hit[i])
+                        continue;
+                if (ix->cnt == ix->max) {
+                        ix->max = ix->max == 0 ? 1024 : ix->max * 2;
+                        REALLOCARRAY(sp, ix->lno, ix->max, sizeof(recno_t));
+                        if (ix->lno == NULL) {
+                                thread_bfree(&sb.b);
+                                search_ifree(sp);
+                                return (0);
+                        }
+                }
+                ix->lno[ix->cnt++] = sb.b.lno + i;
+        }
+        ix->next += sb.b.cnt;
+        if (ix->next > elno)
+                ix->done = 1;
+        thread_bfree(&sb.b);
+        return (1);
+}
+
+/*
+ * search_itime --
+ *      Size the next idle batch from how long this one took, so that a
+ *      batch takes about SINDEX_IMSEC milliseconds.  Only a full batch
+ *      can grow the next one.
+ */
+
+static void
+search_itime(SINDEX *ix, struct timespec *tsp, int full)
+{
+        struct timespec ts;
+        long usec;
+
+        (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+        usec = (ts.tv_sec - tsp->tv_sec) * 1000000 +
+            (ts.tv_nsec - tsp->tv_nsec) / 1000;
+        if (usec < SINDEX_IMSEC * 500 && full && ix->ilines < THREAD_BATCH)
+                ix->ilines *= 2;
+        else if (usec > SINDEX_IMSEC * 1000 && ix->ilines > 1)
+                ix->ilines /= 2;
+}
+
+/*
+ * search_iunit --
+ *      Index one work unit of a batch.
+ */
+
+static int
+search_iunit(void *arg, size_t unit)
+{
+        SBUILD *sb;
+        size_t i, j, n;
+
+        sb = arg;
+        i = unit * THREAD_UNIT;
+        n = i + THREAD_UNIT > sb->b.cnt ? sb->b.cnt : i + THREAD_UNIT;
+        while (i < n) {
+                (void)regexec_lines(sb->re,
+                    sb->b.bp, sb->b.off + i, n - i, &j, 0);
+                for (; j > 0; --j)
+                        sb->hit[i++] = 0;
+                if (i < n)
+                        sb->hit[i++] = 1;
+        }
+        return (0);
+}
+
+/*
+ * search_ifind --
+ *      Look up the first matching line from *lnop as far as elno, in the
+ *      search direction, like search_skip.  Returns 1 if the match index
+ *      answered.
+ */
+
+static int
+search_ifind(SCR *sp, dir_t dir, recno_t *lnop, recno_t elno)
+{
+        SINDEX *ix;
+        size_t i;
+
+        if ((ix = search_isync(sp, MAX_REC_NUMBER)) == NULL || !ix->done)
+                return (0);
+        i = search_ilower(ix, *lnop);
+        if (dir == FORWARD)
+                *lnop = i < ix->cnt && ix->lno[i] <= elno ?
+                    ix->lno[i] : elno + 1;
+        else if (i == ix->cnt || ix->lno[i] != *lnop)
+                *lnop = i > 0 && ix->lno[i - 1] >= elno ?
+                    ix->lno[i - 1] : elno - 1;
+        return (1);
+}
+
+/*
+ * search_isync --
+ *      Return the screen's match index, if it can be used, after merging
+ *      any logged changes into it and searching up to max of the changed
+ *      lines.
+ */
+
+static SINDEX *
+search_isync(SCR *sp, recno_t max)
+{
+        SINDEX *ix;
+
+        if ((ix = sp->sidx) == NULL || ix->ep != sp->ep ||
+            !F_ISSET(sp, SC_RE_SEARCH) || F_ISSET(sp, SC_TINPUT))
+                return (NULL);
+        if ((ix->nlog != 0 && search_imerge(sp, ix)) ||
+            (ix->ndirty != 0 && search_iscan(sp, ix, max))) {
+                search_ifree(sp);
+                return (NULL);
+        }
+        return (ix);
+}
+
+/*
+ * search_imerge --
+ *      Merge the logged changes into the match index.
+ *
+ *      The changes are played over a list of pieces of the file as it now
+ *      is: runs of lines that were there before the first logged change,
+ *      by their old line numbers, and runs of new or changed lines.  The
+ *      last piece runs on past the end of the file.  Then one pass over
+ *      the pieces renumbers the indexed and changed lines, and adds the
+ *      new lines to the changed ones, unless they haven't been indexed.
+ */
+
+static int
+search_imerge(SCR *sp, SINDEX *ix)
+{
+        SRANGE pc[3 * SINDEX_LOG + 1], *dirty, *dp, *ep;
+        recno_t cur, first, lno, n, next, stop;
+        size_t i, j, k, ndirty, npc;
+
+        /* Play the changes over the pieces. */
+        pc[0].lno = 1;
+        pc[0].cnt = MAX_REC_NUMBER - 1;
+        npc = 1;
+        for (k = 0; k < ix->nlog; ++k) {
+                lno = ix->log[k].lno;
+                n = ix->log[k].cnt;
+                if (ix->log[k].op != LINE_INSERT) {
+                        i = search_isplit(pc, &npc, lno);
+                        j = search_isplit(pc, &npc, lno + n);
+                        memmove(pc + i, pc + j, (npc - j) * sizeof(SRANGE));
+                        npc -= j - i;
+                }
+                if (ix->log[k].op != LINE_DELETE) {
+                        i = search_isplit(pc, &npc, lno);
+                        memmove(pc + i + 1, pc + i, (npc - i) * sizeof(SRANGE));
+                        ++npc;
+                        pc[i].lno = 0;
+                        pc[i].cnt = n;
+                }
+        }
+        ix->nlog = 0;
+
+        /* Where the first line not yet indexed, or the one after it, is. */
+        for (cur = 1, k = 0;; cur += pc[k].cnt, ++k)
+                if (pc[k].lno != 0 && ix->next - pc[k].lno < pc[k].cnt) {
+                        next = cur + (ix->next - pc[k].lno);
+                        break;
+                } else if (pc[k].lno > ix->next) {
+                        next = cur;
+                        break;
+                }
+
+        /* Renumber the indexed lines, dropping changed ones. */
+        for (cur = 1, i = j = k = 0; i < ix->cnt; ++i) {
+                for (lno = ix->lno[i]; pc[k].lno == 0 ||
+                    lno - pc[k].lno >= pc[k].cnt; cur += pc[k++].cnt)
+                        if (pc[k].lno > lno)
+                                break;
+                if (pc[k].lno != 0 && pc[k].lno <= lno)
+                        ix->lno[j++] = cur + (lno - pc[k].lno);
+        }
+        ix->cnt = j;
+
+        /*
+         * Renumber the changed lines, and add the new ones.  Each piece
+         * adds a range at most, or splits one.
+         */
+        if ((dirty = calloc(ix->ndirty + npc, sizeof(SRANGE))) == NULL) {
+                msgq(sp, M_SYSERR, NULL);
+                return (1);
+        }
+        ndirty = 0;
+        dp = ix->dirty;
+        ep = ix->dirty + ix->ndirty;
+        for (cur = 1, k = 0; cur < next; cur += pc[k++].cnt) {
+                if (pc[k].lno == 0) {
+                        search_iadd(dirty, &ndirty, cur, cur + pc[k].cnt);
+                        continue;
+                }
+                stop = pc[k].lno + pc[k].cnt;
+                for (; dp < ep && dp->lno + dp->cnt <= pc[k].lno; ++dp)
+                        continue;
+                for (; dp < ep && dp->lno < stop; ++dp) {
+                        first = dp->lno > pc[k].lno ? dp->lno : pc[k].lno;
+                        lno = dp->lno + dp->cnt < stop ?
+                            dp->lno + dp->cnt : stop;
+                        search_iadd(dirty, &ndirty,
+                            cur + (first - pc[k].lno), cur + (lno - pc[k].lno));
+                        if (dp->lno + dp->cnt > stop)
+                                break;
+                }
+                if (next - cur <= pc[k].cnt)
+                        break;
+        }
+        free(ix->dirty);
+        ix->dirty = dirty;
+        ix->ndirty = ndirty;
+        ix->next = next;
+        return (0);
+}
+
+/*
+ * search_iadd --
+ *      Add lines first to stop - 1 to the end of a list of ranges.
+ */
+
+static void
+search_iadd(SRANGE *rp, size_t *nrp, recno_t first, recno_t stop)
+{
+        if (*nrp != 0 && rp[*nrp - 1].lno + rp[*nrp - 1].cnt == first)
+                rp[*nrp - 1].cnt += stop - first;
+        else {
+                rp[*nrp].lno = first;
+                rp[*nrp].cnt = stop - first;
+                ++*nrp;
+        }
+}
+
+/*
+ * search_isplit --
+ *      Start a piece at line lno, and return its offset.
+ */
+
+static size_t
+search_isplit(SRANGE *pc, size_t *npcp, recno_t lno)
+{
+        recno_t cur, off;
+        size_t i;
+
+        for (cur = 1, i = 0; lno - cur >= pc[i].cnt; cur += pc[i++].cnt)
+                continue;
+        if ((off = lno - cur) != 0) {
+                memmove(pc + i + 2,
+                    pc + i + 1, (*npcp - i - 1) * sizeof(SRANGE));
+                ++*npcp;
+                pc[i + 1].lno = pc[i].lno == 0 ? 0 : pc[i].lno + off;
+                pc[i + 1].cnt = pc[i].cnt - off;
+                pc[i].cnt = off;
+                ++i;
+        }
+        return (i);
+}
+
+/*
+ * search_iscan --
+ *      Search up to max of the changed lines, first to last, and put the
+ *      matching ones in the match index.
+ */
+
+static int
+search_iscan(SCR *sp, SINDEX *ix, recno_t max)
+{
+        SBUILD sb;
+        SRANGE *dp;
+        recno_t *lnop, left, lno, n, stop;
+        size_t cnt, i, j, k, nlno;
+
+        for (nlno = ix->cnt, left = max, k = 0;
+            k < ix->ndirty && left != 0; left -= n, ++k) {
+                n = ix->dirty[k].cnt < left ? ix->dirty[k].cnt : left;
+                nlno += n;
+        }
+        MALLOC_RET(sp, lnop, nlno * sizeof(recno_t));
+
+        sb.b.bp = NULL;
+        sb.b.blen = 0;
+        sb.b.off = NULL;
+        sb.b.omax = 0;
+        sb.re = &sp->re_c;
+        for (cnt = i = k = 0; k < ix->ndirty && max != 0; max -= n, ++k) {
+                dp = ix->dirty + k;
+                n = dp->cnt < max ? dp->cnt : max;
+                lno = dp->lno;
+                stop = lno + n;
+                for (; i < ix->cnt && ix->lno[i] < lno; ++i)
+                        lnop[cnt++] = ix->lno[i];
+                for (; i < ix->cnt && ix->lno[i] < stop; ++i)
+                        continue;
+                for (; lno < stop; lno += sb.b.cnt) {
+                        if (thread_batch(sp, &sb.b, lno, stop - 1)) {
+                                thread_bfree(&sb.b);
+                                free(lnop);
+                                return (1);
+                        }
+                        thread_run(LBATCH_UNITS(&sb.b), search_iunit, &sb);
+                        for (j = 0; j < sb.b.cnt; ++j)
+                                if (sb.hit[j])
+                                        lnop[cnt++] = lno + j;
+                }
+                if (n < dp->cnt) {
+                        dp->lno += n;
+                        dp->cnt -= n;
+                        break;
+                }
+        }
+        for (; i < ix->cnt; ++i)
+                lnop[cnt++] = ix->lno[i];
+        thread_bfree(&sb.b);
+
+        free(ix->lno);
+        ix->lno = lnop;
+        ix->cnt = cnt;
+        ix->max = nlno;
+        memmove(ix->dirty, ix->dirty + k, (ix->ndirty - k) * sizeof(SRANGE));
+        ix->ndirty -= k;
+        return (0);
+}
+
+/*
+ * search_ilower --
+ *      Return the offset of the first indexed line at or after lno.
+ */
+
+static size_t
+search_ilower(SINDEX *ix, recno_t lno)
+{
+        size_t hi, lo, mid;
+
+        for (lo = 0, hi = ix->cnt; lo < hi;) {
+                mid = lo + (hi - lo) / 2;
+                if (ix->lno[mid] < lno)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+        return (lo);
+}
+
+/*
+ * search_insdel --
+ *      Log a change to a file in the match indices of the screens
+ *      editing it.
+ *
+ * PUBLIC: void search_insdel(SCR *, lnop_t, recno_t);
+ */
+
+void
+search_insdel(SCR *sp, lnop_t op, recno_t lno)
+{
+        SCR *tsp;
+
+        search_ilog(sp, sp->ep, op, lno);
+        if (sp->ep->refcnt == 1)
+                return;
+        TAILQ_FOREACH(tsp, &sp->gp->dq, q)
+                if (tsp != sp)
+                        search_ilog(tsp, sp->ep, op, lno);
+        TAILQ_FOREACH(tsp, &sp->gp->hq, q)
+                if (tsp != sp)
+                        search_ilog(tsp, sp->ep, op, lno);
+}
+
+/*
+ * search_ilog --
+ *      Log a change in a screen's match index.  A change next to the last
+ *      one logged extends it.
+ */
+
+static void
+search_ilog(SCR *sp, EXF *ep, lnop_t op, recno_t lno)
+{
+        SINDEX *ix;
+        recno_t first;
+
+        if ((ix = sp->sidx) == NULL || ix->ep != ep)
+                return;
+        if (ix->nlog != 0) {
+                first = ix->log[ix->nlog - 1].lno;
+                switch (ix->log[ix->nlog - 1].op) {
+                case LINE_DELETE:
+                        if (op == LINE_DELETE &&
+                            (lno == first || lno + 1 == first)) {
+                                ix->log[ix->nlog - 1].lno = lno;
+                                ++ix->log[ix->nlog - 1].cnt;
+                                return;
+                        }
+                        break;
+                case LINE_INSERT:
+                        if (lno < first ||
+                            lno - first > ix->log[ix->nlog - 1].cnt)
+                                break;
+                        if (op == LINE_INSERT) {
+                                ++ix->log[ix->nlog - 1].cnt;
+                                return;
+                        }
+                        if (op == LINE_RESET &&
+                            lno - first < ix->log[ix->nlog - 1].cnt)
+                                return;
+                        break;
+                case LINE_RESET:
+                        if (op != LINE_RESET)
+                                break;
+                        if (lno + 1 == first) {
+                                ix->log[ix->nlog - 1].lno = lno;
+                                ++ix->log[ix->nlog - 1].cnt;
+                                return;
+                        }
+                        if (lno < first ||
+                            lno - first > ix->log[ix->nlog - 1].cnt)
+                                break;
+                        if (lno - first == ix->log[ix->nlog - 1].cnt)
+                                ++ix->log[ix->nlog - 1].cnt;
+                        return;
+                default:
+                        break;
+                }
+        }
+
+        /* If the log is full, merge it; if that fails, start over. */
+        if (ix->nlog == SINDEX_LOG && search_imerge(sp, ix)) {
+                search_istart(ix);
+                ix->nlog = 0;
+        }
+        ix->log[ix->nlog].op = op;
+        ix->log[ix->nlog].lno = lno;
+        ix->log[ix->nlog].cnt = 1;
+        ++ix->nlog;
+}
+
+/*
+ * search_istart --
+ *      Start a match index over.
+ */
+
+static void
+search_istart(SINDEX *ix)
+{
+        free(ix->dirty);
+        ix->dirty = NULL;
+        ix->ndirty = 0;
+        ix->cnt = 0;
+        ix->next = 1;
+        ix->ilines = SINDEX_ILINES;
+        ix->done = 0;
+}
+
+/*
+ * search_ifree --
+ *      Discard the screen's match index.
+ *
+ * PUBLIC: void search_ifree(SCR *);
+ */
+
+void
+search_ifree(SCR *sp)
+{
+        if (sp->sidx == NULL)
+                return;
+        free(sp->sidx->lno);
+        free(sp->sidx->dirty);
+        free(sp->sidx);
+        sp->sidx = NULL;
+}
+
 /*
  * search_msg --
  *      Display one of the search messages.
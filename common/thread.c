@@ -0,0 +1,243 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Copyright (c) 2022-2023 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * See the LICENSE.md file for redistribution information.
+ */
+
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <bitstring.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <bsd_stdlib.h>
+#include <bsd_string.h>
+#include <bsd_unistd.h>
+
+#include "common.h"
+
+#define THREAD_MAX      64              /* Maximum number of threads. */
+#define THREAD_STACK    (8 * 1024 * 1024) /* Minimum thread stack size. */
+
+typedef struct _pool {
+        pthread_mutex_t mtx;            /* Protects next and found. */
+        size_t  next;                   /* Next work unit. */
+        size_t  nunits;                 /* Number of work units. */
+        size_t  found;                  /* First unit that succeeded. */
+        int   (*fn)(void *, size_t);    /* Work function. */
+        void   *arg;                    /* Work function argument. */
+        int     first;                  /* Stop after first success. */
+} POOL;
+
+static size_t thread_pool(size_t, int (*)(void *, size_t), void *, int);
+static void  *thread_main(void *);
+
+/*
+ * thread_count --
+ *      Return the number of threads to use for parallel work.
+ *
+ * PUBLIC: int thread_count(void);
+ */
+
+int
+thread_count(void)
+{
+        static int count;
+        long n;
+
+        if (count == 0) {
+                n = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+                n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif /* ifdef _SC_NPROCESSORS_ONLN */
+                if (n < 1)
+                        n = 1;
+                if (n > THREAD_MAX)
+                        n = THREAD_MAX;
+                count = n;
+        }
+        return (count);
+}
+
+/*
+ * thread_run --
+ *      Call a function for each of a number of work units, using as many
+ *      threads as are useful.  The calling thread does its share of the
+ *      work, and the work is complete when thread_run returns.  If threads
+ *      can't be created, the work is done by the calling thread.
+ *
+ * PUBLIC: void thread_run(size_t, int (*)(void *, size_t), void *);
+ */
+
+void
+thread_run(size_t nunits, int (*fn)(void *, size_t), void *arg)
+{
+        (void)thread_pool(nunits, fn, arg, 0);
+}
+
+/*
+ * thread_first --
+ *      Like thread_run, but the function returns non-zero if the work unit
+ *      found what it was looking for.  Work units are started in order, and
+ *      no unit is started after one that succeeded, so every unit before the
+ *      first success is run.  Returns the first unit that succeeded, or
+ *      nunits if none did.
+ *
+ * PUBLIC: size_t thread_first(size_t, int (*)(void *, size_t), void *);
+ */
+
+size_t
+thread_first(size_t nunits, int (*fn)(void *, size_t), void *arg)
+{
+        return (thread_pool(nunits, fn, arg, 1));
+}
+
+/*
+ * thread_pool --
+ *      Start the threads and wait for the work to be done.
+ */
+
+static size_t
+thread_pool(size_t nunits, int (*fn)(void *, size_t), void *arg, int first)
+{
+        POOL pool;
+        pthread_attr_t attr;
+        pthread_t tid[THREAD_MAX];
+        sigset_t all, omask;
+        size_t i, nthreads, ssize;
+
+        nthreads = thread_count();
+        if (nthreads > nunits)
+                nthreads = nunits;
+        if (nthreads <= 1) {
+serial:         for (i = 0; i < nunits; ++i)
+                        if (fn(arg, i) && first)
+                                return (i);
+                return (nunits);
+        }
+
+        pool.next = 0;
+        pool.nunits = pool.found = nunits;
+        pool.fn = fn;
+        pool.arg = arg;
+        pool.first = first;
+        if (pthread_mutex_init(&pool.mtx, NULL) != 0)
+                goto serial;
+        if (pthread_attr_init(&attr) != 0) {
+                (void)pthread_mutex_destroy(&pool.mtx);
+                goto serial;
+        }
+
+        /*
+         * The regex back reference code recurses about once per character
+         * matched, and some systems give new threads very small stacks.
+         */
+        if (pthread_attr_getstacksize(&attr, &ssize) == 0 &&
+            ssize < THREAD_STACK)
+                (void)pthread_attr_setstacksize(&attr, THREAD_STACK);
+
+        /*
+         * Signals are only handled by the main thread, the signal handlers
+         * set flags which the editor checks between batches of work.  The
+         * new threads inherit the blocked signal mask.
+         */
+        (void)sigfillset(&all);
+        (void)pthread_sigmask(SIG_BLOCK, &all, &omask);
+        for (i = 0; i < nthreads - 1; ++i)
+                if (pthread_create(&tid[i], &attr, thread_main, &pool) != 0)
+                        break;
+        (void)pthread_sigmask(SIG_SETMASK, &omask, NULL);
+        (void)pthread_attr_destroy(&attr);
+
+        (void)thread_main(&pool);
+        while (i > 0)
+                (void)pthread_join(tid[--i], NULL);
+        (void)pthread_mutex_destroy(&pool.mtx);
+        return (pool.found);
+}
+
+/*
+ * thread_main --
+ *      Take work units until there are none left.
+ */
+
+static void *
+thread_main(void *arg)
+{
+        POOL *pool;
+        size_t unit;
+
+        for (pool = arg;;) {
+                (void)pthread_mutex_lock(&pool->mtx);
+                unit = pool->next < pool->found ? pool->next++ : pool->nunits;
+                (void)pthread_mutex_unlock(&pool->mtx);
+                if (unit == pool->nunits)
+                        break;
+                if (pool->fn(pool->arg, unit) && pool->first) {
+                        (void)pthread_mutex_lock(&pool->mtx);
+                        if (unit < pool->found)
+                                pool->found = unit;
+                        (void)pthread_mutex_unlock(&pool->mtx);
+                }
+        }
+        return (NULL);
+}
+
+/*
+ * thread_batch --
+ *      Copy lines out of the file into a batch, starting at lno and ending
+ *      no later than elno.  At least one line is copied, unless the first
+ *      line doesn't exist.
+ *
+ * PUBLIC: int thread_batch(SCR *, LBATCH *, recno_t, recno_t);
+ */
+
+int
+thread_batch(SCR *sp, LBATCH *bp, recno_t lno, recno_t elno)
+{
+        size_t len, off;
+        char *p;
+
+        bp->lno = lno;
+        bp->cnt = 0;
+        for (off = 0; lno <= elno && bp->cnt < THREAD_BATCH &&
+            (bp->cnt == 0 || off < THREAD_BMAX); ++lno, ++bp->cnt) {
+                if (db_get(sp, lno, DBG_FATAL, &p, &len))
+                        return (1);
+                if (bp->cnt + 2 > bp->omax) {
+                        bp->omax = bp->omax == 0 ? 1024 : bp->omax * 2;
+                        REALLOCARRAY(sp, bp->off, bp->omax, sizeof(size_t));
+                        if (bp->off == NULL) {
+                                bp->omax = 0;
+                                return (1);
+                        }
+                }
+                BINC_RET(sp, bp->bp, bp->blen, off + len + 1);
+                memcpy(bp->bp + off, p, len);
+                bp->off[bp->cnt] = off;
+                off += len;
+        }
+        if (bp->off != NULL)
+                bp->off[bp->cnt] = off;
+        return (0);
+}
+
+/*
+ * thread_bfree --
+ *      Release the memory held by a batch.
+ *
+ * PUBLIC: void thread_bfree(LBATCH *);
+ */
+
+void
+thread_bfree(LBATCH *bp)
+{
+        free(bp->bp);
+        free(bp->off);
+        memset(bp, 0, sizeof(LBATCH));
+}
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Copyright (c) 2022-2023 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * See the LICENSE.md file for redistribution information.
+ */
+
+/*
+ * The underlying database, the screen and the message code are all single
+ * threaded.  Threads are only used for work that can be done against a copy
+ * of part of the file, e.g. running a regular expression over a range of
+ * lines.  The main thread copies a batch of lines out of the database into
+ * an LBATCH, and the batch is then split into work units that are handed
+ * out to a set of threads by thread_run().  Work units may read the SCR, but
+ * never change it or touch the EXF, and results are merged in order by the
+ * main thread.
+ */
+
+#define THREAD_UNIT     1024                    /* Lines per work unit. */
+#define THREAD_BATCH    (64 * THREAD_UNIT)      /* Lines per batch.     */
+#define THREAD_BMAX     (8 * 1024 * 1024)       /* Bytes per batch.     */
+
+typedef struct _lbatch LBATCH;
+struct _lbatch {
+        recno_t  lno;                   /* First line number.     */
+        size_t   cnt;                   /* Number of lines.       */
+        char    *bp;                    /* Line text.             */
+        size_t   blen;                  /* Line text buffer size. */
+        size_t  *off;                   /* Line offsets, cnt + 1. */
+        size_t   omax;                  /* Line offsets size.     */
+};
+
+/* Line n of a batch, and its length. */
+#define LBATCH_LINE(b, n)       ((b)->bp + (b)->off[n])
+#define LBATCH_LEN(b, n)        ((b)->off[(n) + 1] - (b)->off[n])
+
+/* Number of work units in a batch. */
+#define LBATCH_UNITS(b)         (((b)->cnt + THREAD_UNIT - 1) / THREAD_UNIT)
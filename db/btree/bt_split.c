@@ -96,6 +96,9 @@ __bt_split(BTREE *t, PAGE *sp, const DBT *key, const DBT *data, int flags,
         int parentsplit;
         char *dest;
 
+        /* The recno search can't start from its last leaf any more. */
+        t->bt_rleaf = P_INVALID;
+
         /*
          * Split the page into two pages, l and r.  The split routines return
          * a pointer to the page into which the key should be inserted and with
@@ -364,6 +364,10 @@ typedef struct _btree {
         size_t    bt_msize;             /* R: size of mapped region. */
 
         recno_t   bt_nrecs;             /* R: number of records */
+        pgno_t    bt_rleaf;             /* R: leaf page of the last search */
+        recno_t   bt_rtotal;            /* R: records before that leaf */
+        EPGNO     bt_rpath[50];         /* R: parents of that leaf */
+        EPGNO    *bt_rsp;               /* R: end of the parents */
         size_t    bt_reclen;            /* R: fixed record length */
         unsigned char    bt_bval;       /* R: delimiting byte/pad character */
 
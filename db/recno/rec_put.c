@@ -197,6 +197,7 @@ __rec_iput(BTREE *t, recno_t nrec, const DBT *data, unsigned int flags)
         DBT tdata;
         EPG *e;
         PAGE *h;
+        RLEAF *rl;
         indx_t idx, nxtindex;
         pgno_t pg;
         u_int32_t nbytes;
@@ -245,6 +246,22 @@ __rec_iput(BTREE *t, recno_t nrec, const DBT *data, unsigned int flags)
         case R_IBEFORE:
                 break;
         default:
+                /*
+                 * If the new record takes the same room on the page as the
+                 * old one, e.g. a line with its case changed, overwrite it
+                 * rather than deleting it and packing the page twice.
+                 */
+                if (nrec < t->bt_nrecs && dflags == 0) {
+                        rl = GETRLEAF(h, idx);
+                        if (!(rl->flags & P_BIGDATA) &&
+                            NRLEAF(rl) == NRLEAFDBT(data->size)) {
+                                dest = (char *)rl;
+                                WR_RLEAF(dest, data, 0);
+                                F_SET(t, B_MODIFIED);
+                                mpool_put(t->bt_mp, h, MPOOL_DIRTY);
+                                return (RET_SUCCESS);
+                        }
+                }
                 if (nrec < t->bt_nrecs &&
                     __rec_dleaf(t, h, idx) == RET_ERROR) {
                         mpool_put(t->bt_mp, h, 0);
@@ -70,7 +70,7 @@ EPG *
 __rec_search(BTREE *t, recno_t recno, enum SRCHOP op)
 {
         indx_t idx;
-        PAGE *h;
+        PAGE *h, *p;
         EPGNO *parent;
         RINTERNAL *r;
         pgno_t pg;
@@ -79,10 +79,56 @@ __rec_search(BTREE *t, recno_t recno, enum SRCHOP op)
         int sverrno;
 
         BT_CLR(t);
+
+        /*
+         * Most searches are for a record on the same leaf page as the one
+         * before, e.g. when reading through the file a line at a time, or
+         * deleting a range of lines.  If nothing has changed the shape of
+         * the tree since, start there and skip the walk down from the root.
+         * Inserts and deletes fix the counts along the remembered path, and
+         * splits forget the leaf.  The last leaf also takes the records
+         * appended after it, as the walk always ends there for those.
+         */
+        if (t->bt_rleaf != P_INVALID && recno >= t->bt_rtotal) {
+                if ((h = mpool_get(t->bt_mp, t->bt_rleaf, 0)) == NULL)
+                        goto err;
+                if (recno - t->bt_rtotal < NEXTINDEX(h) ||
+                    h->nextpg == P_INVALID) {
+                        for (parent = t->bt_rpath;
+                            parent < t->bt_rsp; ++parent) {
+                                if (op != SEARCH) {
+                                        if ((p = mpool_get(t->bt_mp,
+                                            parent->pgno, 0)) == NULL) {
+                                                mpool_put(t->bt_mp, h, 0);
+                                                goto err;
+                                        }
+                                        if (op == SINSERT)
+                                                ++GETRINTERNAL(p,
+                                                    parent->index)->nrecs;
+                                        else
+                                                --GETRINTERNAL(p,
+                                                    parent->index)->nrecs;
+                                        mpool_put(t->bt_mp, p, MPOOL_DIRTY);
+                                }
+                                *t->bt_sp++ = *parent;
+                        }
+                        t->bt_cur.page = h;
+                        t->bt_cur.index = recno - t->bt_rtotal;
+                        return (&t->bt_cur);
+                }
+                mpool_put(t->bt_mp, h, 0);
+        }
+
         for (pg = P_ROOT, total = 0;;) {
                 if ((h = mpool_get(t->bt_mp, pg, 0)) == NULL)
                         goto err;
                 if (h->flags & P_RLEAF) {
+                        t->bt_rleaf = pg;
+                        t->bt_rtotal = total;
+                        for (t->bt_rsp = t->bt_rpath,
+                            parent = t->bt_stack;
+                            parent < t->bt_sp; ++parent)
+                                *t->bt_rsp++ = *parent;
                         t->bt_cur.page = h;
                         t->bt_cur.index = recno - total;
                         return (&t->bt_cur);
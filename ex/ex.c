@@ -1374,12 +1374,16 @@ addr_verify:
         }
 
         /*
-         * Call the underlying function for the ex command.
+         * Call the underlying function for the ex command.  The screens
+         * are updated for the lines it changes once it's done.
          *
          * XXX
          * Interrupts behave like errors, for now.
          */
-        if (ecp->cmd->fn(sp, ecp) || INTERRUPTED(sp)) {
+        vs_bulk(sp, 1);
+        tmp = ecp->cmd->fn(sp, ecp);
+        vs_bulk(sp, 0);
+        if (tmp || INTERRUPTED(sp)) {
                 if (F_ISSET(gp, G_SCRIPTED))
                         F_SET(sp, SC_EXIT_FORCE);
                 goto err;
@@ -2063,7 +2067,7 @@ ex_load(SCR *sp)
 {
         GS *gp;
         EXCMD *ecp;
-        RANGE *rp;
+        recno_t lno;
 
         F_CLR(sp, SC_EX_GLOBAL);
 
@@ -2100,18 +2104,10 @@ ex_load(SCR *sp)
                  * the command on a different line.
                  */
                 if (FL_ISSET(ecp->agv_flags, AGV_ALL)) {
-                        /* Discard any exhausted ranges. */
-                        while ((rp = TAILQ_FIRST(&ecp->rq))) {
-                                if (rp->start > rp->stop) {
-                                        TAILQ_REMOVE(&ecp->rq, rp, q);
-                                        free(rp);
-                                } else
-                                        break;
-                        }
-
-                        /* If there's another range, continue with it. */
-                        if (rp)
+                        /* If there's another line, continue with it. */
+                        if (!ex_g_next(&ecp->rq, &lno))
                                 break;
+                        ex_g_free(&ecp->rq);
 
                         /* If it's a global/v command, fix up the last line. */
                         if (FL_ISSET(ecp->agv_flags,
@@ -2142,7 +2138,7 @@ ex_load(SCR *sp)
         ecp->cp = ecp->o_cp;
         memcpy(ecp->cp, ecp->cp + ecp->o_clen, ecp->o_clen);
         ecp->clen = ecp->o_clen;
-        ecp->range_lno = sp->lno = rp->start++;
+        ecp->range_lno = sp->lno = lno;
 
         if (FL_ISSET(ecp->agv_flags, AGV_GLOBAL | AGV_V))
                 F_SET(sp, SC_EX_GLOBAL);
@@ -2158,7 +2154,6 @@ ex_discard(SCR *sp)
 {
         GS *gp;
         EXCMD *ecp;
-        RANGE *rp;
 
         /*
          * We know the first command can't be an AGV command, so we don't
@@ -2166,10 +2161,7 @@ ex_discard(SCR *sp)
          */
         for (gp = sp->gp; (ecp = LIST_FIRST(&gp->ecq)) != &gp->excmd;) {
                 if (FL_ISSET(ecp->agv_flags, AGV_ALL)) {
-                        while ((rp = TAILQ_FIRST(&ecp->rq))) {
-                                TAILQ_REMOVE(&ecp->rq, rp, q);
-                                free(rp);
-                        }
+                        ex_g_free(&ecp->rq);
                         free(ecp->o_cp);
                 }
                 LIST_REMOVE(ecp, q);
@@ -70,11 +70,19 @@ extern EXCMDLIST const cmds[];          /* Table of ex commands. */
         }                                                               \
 }
 
-/* Range structures for global and @ commands. */
+/*
+ * Line sets for global and @ commands.  The lines are kept in ascending
+ * order, and line insertions and deletions are tracked as deltas in a
+ * Fenwick tree.  See ex_global.c.
+ */
 typedef struct _range RANGE;
-struct _range {                         /* Global command range.    */
-        TAILQ_ENTRY(_range) q;          /* Linked list of ranges.   */
-        recno_t start, stop;            /* Start/stop of the range. */
+struct _range {                         /* Global command lines.     */
+        recno_t  *lno;                  /* Line numbers, ascending.  */
+        long     *delta;                /* Line number deltas.       */
+        bitstr_t *gone;                 /* Lines that were deleted.  */
+        size_t    cur;                  /* Next line to execute.     */
+        size_t    cnt;                  /* Lines in the set.         */
+        size_t    max;                  /* Allocated lines.          */
 };
 
 /* Ex command structure. */
@@ -98,7 +106,7 @@ struct _excmd {
         EXCMDLIST const *cmd;           /* Command: entry in command table.  */
         EXCMDLIST rcmd;                 /* Command: table entry/replacement. */
 
-        TAILQ_HEAD(_rh, _range) rq;     /* @/global range: linked list.      */
+        RANGE     rq;                   /* @/global range: line set.         */
         recno_t   range_lno;            /* @/global range: set line number.  */
         char     *o_cp;                 /* Original @/global command.        */
         size_t    o_clen;               /* Original @/global command length. */
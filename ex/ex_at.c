@@ -38,8 +38,8 @@ ex_at(SCR *sp, EXCMD *cmdp)
         CB *cbp;
         CHAR_T name;
         EXCMD *ecp;
-        RANGE *rp;
         TEXT *tp;
+        recno_t lno;
         size_t len;
         char *p;
 
@@ -81,17 +81,20 @@ ex_at(SCR *sp, EXCMD *cmdp)
          * means @ buffers are still useful in a multi-screen environment.
          */
         CALLOC_RET(sp, ecp, 1, sizeof(EXCMD));
-        TAILQ_INIT(&ecp->rq);
-        CALLOC_RET(sp, rp, 1, sizeof(RANGE));
-        rp->start = cmdp->addr1.lno;
         if (F_ISSET(cmdp, E_ADDR_DEF)) {
-                rp->stop = rp->start;
+                if (ex_g_add(sp, &ecp->rq, cmdp->addr1.lno)) {
+                        free(ecp);
+                        return (1);
+                }
                 FL_SET(ecp->agv_flags, AGV_AT_NORANGE);
         } else {
-                rp->stop = cmdp->addr2.lno;
+                for (lno = cmdp->addr1.lno; lno <= cmdp->addr2.lno; ++lno)
+                        if (ex_g_add(sp, &ecp->rq, lno)) {
+                                free(ecp);
+                                return (1);
+                        }
                 FL_SET(ecp->agv_flags, AGV_AT);
         }
-        TAILQ_INSERT_HEAD(&ecp->rq, rp, q);
 
         /*
          * Buffers executed in ex mode or from the colon command line in vi
@@ -28,7 +28,19 @@
 
 enum which {GLOBAL, V};
 
-static int ex_g_setup(SCR *, EXCMD *, enum which);
+/* Match phase state, shared with the matching threads. */
+typedef struct {
+        LBATCH   b;                     /* Lines being matched.    */
+        regex_t *re;                    /* Compiled RE.            */
+        int     *eval;                  /* Per-line regexec value. */
+        size_t   emax;                  /* Allocated eval entries. */
+} GMATCH;
+
+static int     ex_g_setup(SCR *, EXCMD *, enum which);
+static int     ex_g_match(void *, size_t);
+static long    ex_g_delta(RANGE *, size_t);
+static void    ex_g_shift(RANGE *, size_t, long);
+static size_t  ex_g_lower(RANGE *, recno_t);
 
 /*
  * ex_global -- [line [,line]] g[lobal][!] /pattern/ [commands]
@@ -64,15 +76,12 @@ ex_g_setup(SCR *sp, EXCMD *cmdp, enum which cmd)
 {
         CHAR_T *ptrn, *p, *t;
         EXCMD *ecp;
+        GMATCH gm;
         MARK abs_mark;
-        RANGE *rp;
         busy_t btype;
         recno_t start, end;
-        regex_t *re;
-        regmatch_t match[1];
-        size_t len;
-        int cnt, delim, eval;
-        char *dbp;
+        size_t i, len;
+        int delim, eval, rval;
 
         NEEDFILE(sp, cmdp);
 
@@ -147,8 +156,6 @@ usage:          ex_emsg(sp, cmdp->cmd->usage, EXM_USAGE);
                  */
                 sp->searchdir = FORWARD;
         }
-        re = &sp->re_c;
-        (void)re;
 
         /* The global commands always set the previous context mark. */
         abs_mark.lno = sp->lno;
@@ -158,7 +165,6 @@ usage:          ex_emsg(sp, cmdp->cmd->usage, EXM_USAGE);
 
         /* Get an EXCMD structure. */
         CALLOC_RET(sp, ecp, 1, sizeof(EXCMD));
-        TAILQ_INIT(&ecp->rq);
 
         /*
          * Get a copy of the command string; the default command is print.
@@ -187,73 +193,225 @@ usage:          ex_emsg(sp, cmdp->cmd->usage, EXM_USAGE);
          * really no way to do this in a single pass, since arbitrary line
          * creation, deletion and movement can be done in the ex command.  For
          * example, a good vi clone test is ":g/X/mo.-3", or "g/X/.,.+1d".
-         * What we do is create linked list of lines that are tracked through
-         * each ex command.  There's a callback routine which the DB interface
+         * What we do is create a set of lines that are tracked through each
+         * ex command.  There's a callback routine which the DB interface
          * routines call when a line is created or deleted.  This doesn't help
          * the layering much.
+         *
+         * The matching is done in batches of lines copied out of the file,
+         * each batch is matched by as many threads as are useful, and the
+         * results are then added to the set in line order.
          */
+        memset(&gm, 0, sizeof(gm));
+        gm.re = &sp->re_c;
         btype = BUSY_ON;
-        cnt = INTERRUPT_CHECK;
+        rval = 0;
         for (start = cmdp->addr1.lno,
-            end = cmdp->addr2.lno; start <= end; ++start) {
-                if (cnt-- == 0) {
-                        if (INTERRUPTED(sp)) {
-                                LIST_REMOVE(ecp, q);
-                                free(ecp->cp);
-                                free(ecp);
+            end = cmdp->addr2.lno; start <= end; start += gm.b.cnt) {
+                if (INTERRUPTED(sp)) {
+                        LIST_REMOVE(ecp, q);
+                        ex_g_free(&ecp->rq);
+                        free(ecp->cp);
+                        free(ecp);
+                        break;
+                }
+                search_busy(sp, btype);
+                btype = BUSY_UPDATE;
+
+                if (thread_batch(sp, &gm.b, start, end)) {
+                        rval = 1;
+                        goto err;
+                }
+                if (gm.b.cnt > gm.emax) {
+                        gm.emax = gm.b.cnt;
+                        REALLOCARRAY(sp, gm.eval, gm.emax, sizeof(int));
+                        if (gm.eval == NULL) {
+                                rval = 1;
+                                goto err;
+                        }
+                }
+                thread_run(LBATCH_UNITS(&gm.b), ex_g_match, &gm);
+
+                for (i = 0; i < gm.b.cnt; ++i) {
+                        switch (eval = gm.eval[i]) {
+                        case 0:
+                                if (cmd == V)
+                                        continue;
+                                break;
+                        case REG_NOMATCH:
+                                if (cmd == GLOBAL)
+                                        continue;
                                 break;
+                        default:
+                                re_error(sp, eval, &sp->re_c);
+                                break;
+                        }
+                        if (ex_g_add(sp, &ecp->rq, start + i)) {
+                                rval = 1;
+                                goto err;
                         }
-                        search_busy(sp, btype);
-                        btype = BUSY_UPDATE;
-                        cnt = INTERRUPT_CHECK;
                 }
-                if (db_get(sp, start, DBG_FATAL, &dbp, &len))
+        }
+err:    search_busy(sp, BUSY_OFF);
+        thread_bfree(&gm.b);
+        free(gm.eval);
+        return (rval);
+}
+
+/*
+ * ex_g_match --
+ *      Match one work unit of a batch of lines.
+ */
+static int
+ex_g_match(void *arg, size_t unit)
+{
+        GMATCH *gm;
+        size_t i, j, n;
+        int eval;
+
+        gm = arg;
+        i = unit * THREAD_UNIT;
+        n = i + THREAD_UNIT > gm->b.cnt ? gm->b.cnt : i + THREAD_UNIT;
+        while (i < n) {
+                eval = regexec_lines(gm->re,
+                    gm->b.bp, gm->b.off + i, n - i, &j, 0);
+                for (; j > 0; --j)
+                        gm->eval[i++] = REG_NOMATCH;
+                if (i < n)
+                        gm->eval[i++] = eval;
+        }
+        return (0);
+}
+
+/*
+ * ex_g_add --
+ *      Append a line to a global command line set.  Lines must be added
+ *      in ascending order, before the set is used.
+ *
+ * PUBLIC: int ex_g_add(SCR *, RANGE *, recno_t);
+ */
+int
+ex_g_add(SCR *sp, RANGE *rp, recno_t lno)
+{
+        size_t nmax;
+
+        if (rp->cnt == rp->max) {
+                nmax = rp->max == 0 ? 256 : rp->max * 2;
+                REALLOCARRAY(sp, rp->lno, nmax, sizeof(recno_t));
+                REALLOCARRAY(sp, rp->delta, nmax + 1, sizeof(long));
+                REALLOC(sp, rp->gone, bitstr_size(nmax));
+                if (rp->lno == NULL || rp->delta == NULL || rp->gone == NULL) {
+                        ex_g_free(rp);
                         return (1);
-                match[0].rm_so = 0;
-                match[0].rm_eo = len;
-                switch (eval =
-                    regexec(&sp->re_c, dbp, 0, match, REG_STARTEND)) {
-                case 0:
-                        if (cmd == V)
-                                continue;
-                        break;
-                case REG_NOMATCH:
-                        if (cmd == GLOBAL)
-                                continue;
-                        break;
-                default:
-                        re_error(sp, eval, &sp->re_c);
-                        break;
                 }
+                memset(rp->delta + rp->max, 0,
+                    (nmax - rp->max + 1) * sizeof(long));
+                memset(rp->gone + bitstr_size(rp->max), 0,
+                    bitstr_size(nmax) - bitstr_size(rp->max));
+                rp->max = nmax;
+        }
+        rp->lno[rp->cnt++] = lno;
+        return (0);
+}
 
-                /* If follows the last entry, extend the last entry's range. */
-                if ((rp = TAILQ_LAST(&ecp->rq, _rh)) && rp->stop == start - 1) {
-                        ++rp->stop;
-                        continue;
+/*
+ * ex_g_next --
+ *      Return the next line from a global command line set, and remove
+ *      it from the set.  Returns 1 if the set is exhausted.
+ *
+ * PUBLIC: int ex_g_next(RANGE *, recno_t *);
+ */
+int
+ex_g_next(RANGE *rp, recno_t *lnop)
+{
+        for (; rp->cur < rp->cnt; ++rp->cur)
+                if (!bit_test(rp->gone, rp->cur)) {
+                        *lnop = rp->lno[rp->cur] + ex_g_delta(rp, rp->cur);
+                        ++rp->cur;
+                        return (0);
                 }
+        return (1);
+}
 
-                /* Allocate a new range, and append it to the list. */
-                CALLOC(sp, rp, 1, sizeof(RANGE));
-                if (rp == NULL)
-                        return (1);
-                rp->start = rp->stop = start;
-                TAILQ_INSERT_TAIL(&ecp->rq, rp, q);
+/*
+ * ex_g_free --
+ *      Release a global command line set.
+ *
+ * PUBLIC: void ex_g_free(RANGE *);
+ */
+void
+ex_g_free(RANGE *rp)
+{
+        free(rp->lno);
+        free(rp->delta);
+        free(rp->gone);
+        memset(rp, 0, sizeof(RANGE));
+}
+
+/*
+ * ex_g_delta --
+ *      Return the line number delta for a line set offset.
+ */
+static long
+ex_g_delta(RANGE *rp, size_t i)
+{
+        long delta;
+
+        for (delta = 0, ++i; i > 0; i -= i & -i)
+                delta += rp->delta[i];
+        return (delta);
+}
+
+/*
+ * ex_g_shift --
+ *      Add a line number delta to the line set from an offset on.
+ */
+static void
+ex_g_shift(RANGE *rp, size_t i, long delta)
+{
+        for (++i; i <= rp->cnt; i += i & -i)
+                rp->delta[i] += delta;
+}
+
+/*
+ * ex_g_lower --
+ *      Return the offset of the first unexecuted line in the set at or
+ *      after a line number.
+ */
+static size_t
+ex_g_lower(RANGE *rp, recno_t lno)
+{
+        size_t hi, lo, mid;
+
+        for (lo = rp->cur, hi = rp->cnt; lo < hi;) {
+                mid = lo + (hi - lo) / 2;
+                if ((recno_t)(rp->lno[mid] + ex_g_delta(rp, mid)) < lno)
+                        lo = mid + 1;
+                else
+                        hi = mid;
         }
-        search_busy(sp, BUSY_OFF);
-        return (0);
+        return (lo);
 }
 
 /*
  * ex_g_insdel --
  *      Update the ranges based on an insertion or deletion.
  *
+ * Every insertion or deletion shifts all of the following lines in the set
+ * by one, which is a single update of the delta tree.  A deleted line is
+ * marked as gone, and shifted along with the lines after it so the set stays
+ * sorted.  A line that's gone is always numbered lower than any line after
+ * it that isn't, so if the first line found is gone, the deleted line wasn't
+ * in the set.
+ *
  * PUBLIC: int ex_g_insdel(SCR *, lnop_t, recno_t);
  */
 int
 ex_g_insdel(SCR *sp, lnop_t op, recno_t lno)
 {
         EXCMD *ecp;
-        RANGE *nrp, *rp;
+        RANGE *rp;
+        size_t i;
 
         /* All insert/append operations are done as inserts. */
         if (op == LINE_APPEND)
@@ -265,48 +423,16 @@ ex_g_insdel(SCR *sp, lnop_t op, recno_t lno)
         LIST_FOREACH(ecp, &sp->gp->ecq, q) {
                 if (!FL_ISSET(ecp->agv_flags, AGV_AT | AGV_GLOBAL | AGV_V))
                         continue;
-                for (rp = TAILQ_FIRST(&ecp->rq); rp != NULL; rp = nrp) {
-                        nrp = TAILQ_NEXT(rp, q);
-
-                        /* If range less than the line, ignore it. */
-                        if (rp->stop < lno)
-                                continue;
-
-                        /*
-                         * If range greater than the line, decrement or
-                         * increment the range.
-                         */
-                        if (rp->start > lno) {
-                                if (op == LINE_DELETE) {
-                                        --rp->start;
-                                        --rp->stop;
-                                } else {
-                                        ++rp->start;
-                                        ++rp->stop;
-                                }
-                                continue;
-                        }
-
-                        /*
-                         * Lno is inside the range, decrement the end point
-                         * for deletion, and split the range for insertion.
-                         * In the latter case, since we're inserting a new
-                         * element, neither range can be exhausted.
-                         */
+                rp = &ecp->rq;
+                if ((i = ex_g_lower(rp, lno)) < rp->cnt) {
                         if (op == LINE_DELETE) {
-                                if (rp->start > --rp->stop) {
-                                        TAILQ_REMOVE(&ecp->rq, rp, q);
-                                        free(rp);
-                                }
-                        } else {
-                                CALLOC_RET(sp, nrp, 1, sizeof(RANGE));
-                                nrp->start = lno + 1;
-                                nrp->stop = rp->stop + 1;
-                                rp->stop = lno - 1;
-                                TAILQ_INSERT_AFTER(&ecp->rq, rp, nrp, q);
-                                rp = nrp;
-                                (void)rp;
-                        }
+                                if (!bit_test(rp->gone, i) &&
+                                    (recno_t)(rp->lno[i] +
+                                    ex_g_delta(rp, i)) == lno)
+                                        bit_set(rp->gone, i);
+                                ex_g_shift(rp, i, -1);
+                        } else
+                                ex_g_shift(rp, i, 1);
                 }
 
                 /*
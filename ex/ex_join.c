@@ -33,6 +33,7 @@
 int
 ex_join(SCR *sp, EXCMD *cmdp)
 {
+        LRANGE r;
         recno_t from, to;
         size_t blen, clen, len, tlen;
         int echar, extra, first;
@@ -153,15 +154,19 @@ ex_join(SCR *sp, EXCMD *cmdp)
         sp->lno = cmdp->addr1.lno;
 
         /* Delete the joined lines. */
+        memset(&r, 0, sizeof(LRANGE));
         for (from = cmdp->addr1.lno, to = cmdp->addr2.lno; to > from; --to)
-                if (db_delete(sp, to))
+                if (db_rdelete(sp, &r, to))
                         goto err;
 
         /* If the original line changed, reset it. */
-        if (!first && db_set(sp, from, bp, tbp - bp)) {
-err:            FREE_SPACE(sp, bp, blen);
+        if ((!first && db_rset(sp, &r, from, bp, tbp - bp)) ||
+            db_rcommit(sp, &r)) {
+err:            db_rfree(&r);
+                FREE_SPACE(sp, bp, blen);
                 return (1);
         }
+        db_rfree(&r);
         FREE_SPACE(sp, bp, blen);
 
         sp->rptlines[L_JOINED] += (cmdp->addr2.lno - cmdp->addr1.lno) + 1;
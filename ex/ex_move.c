@@ -87,10 +87,8 @@ ex_move(SCR *sp, EXCMD *cmdp)
 {
         LMARK *lmp;
         MARK fm1, fm2;
-        recno_t cnt, diff, fl, tl, mfl, mtl;
-        size_t blen, len;
+        recno_t diff, fl, tl, mfl, mtl;
         int mark_reset;
-        char *bp, *p;
 
         NEEDFILE(sp, cmdp);
 
@@ -123,56 +121,24 @@ ex_move(SCR *sp, EXCMD *cmdp)
         mark_reset = 0;
         LIST_FOREACH(lmp, &sp->ep->marks, q)
                 if (lmp->name != ABSMARK1 &&
-                    lmp->lno >= fl && lmp->lno <= tl) {
+                    mark_lno(sp, lmp) >= fl && mark_lno(sp, lmp) <= tl) {
                         mark_reset = 1;
                         F_CLR(lmp, MARK_USERSET);
                         (void)log_mark(sp, lmp);
                 }
 
-        /* Get memory for the copy. */
-        GET_SPACE_RET(sp, bp, blen, 256);
-
-        /* Move the lines. */
+        /* Move the lines, and the marks on them. */
         diff = (fm2.lno - fm1.lno) + 1;
+        if (db_move(sp, fm1.lno, fm2.lno, tl))
+                return (1);
         if (tl > fl) {                          /* Destination > source. */
                 mfl = tl - diff;
                 mtl = tl;
-                for (cnt = diff; cnt--;) {
-                        if (db_get(sp, fl, DBG_FATAL, &p, &len))
-                                return (1);
-                        BINC_RET(sp, bp, blen, len);
-                        memcpy(bp, p, len);
-                        if (db_append(sp, 1, tl, bp, len))
-                                return (1);
-                        if (mark_reset)
-                                LIST_FOREACH(lmp, &sp->ep->marks, q)
-                                        if (lmp->name != ABSMARK1 &&
-                                            lmp->lno == fl)
-                                                lmp->lno = tl + 1;
-                        if (db_delete(sp, fl))
-                                return (1);
-                }
         } else {                                /* Destination < source. */
                 mfl = tl;
                 mtl = tl + diff;
-                for (cnt = diff; cnt--;) {
-                        if (db_get(sp, fl, DBG_FATAL, &p, &len))
-                                return (1);
-                        BINC_RET(sp, bp, blen, len);
-                        memcpy(bp, p, len);
-                        if (db_append(sp, 1, tl++, bp, len))
-                                return (1);
-                        if (mark_reset)
-                                LIST_FOREACH(lmp, &sp->ep->marks, q)
-                                        if (lmp->name != ABSMARK1 &&
-                                            lmp->lno == fl)
-                                                lmp->lno = tl;
-                        ++fl;
-                        if (db_delete(sp, fl))
-                                return (1);
-                }
+                tl += diff;
         }
-        FREE_SPACE(sp, bp, blen);
 
         sp->lno = tl;                           /* Last line moved. */
         sp->cno = 0;
@@ -181,7 +147,8 @@ ex_move(SCR *sp, EXCMD *cmdp)
         if (mark_reset)
                 LIST_FOREACH(lmp, &sp->ep->marks, q)
                         if (lmp->name != ABSMARK1 &&
-                            lmp->lno >= mfl && lmp->lno <= mtl)
+                            mark_lno(sp, lmp) >= mfl &&
+                            mark_lno(sp, lmp) <= mtl)
                                 (void)log_mark(sp, lmp);
 
         sp->rptlines[L_MOVED] += diff;
@@ -67,6 +67,7 @@ ex_retab(SCR *sp, EXCMD *cmdp)
 static int
 shift(SCR *sp, EXCMD *cmdp, enum which rl)
 {
+        LRANGE r;
         recno_t from, to;
         size_t blen, len, newcol, newidx, oldcol, oldidx, sw;
         int curset;
@@ -98,6 +99,7 @@ shift(SCR *sp, EXCMD *cmdp, enum which rl)
 
         GET_SPACE_RET(sp, bp, blen, 256);
 
+        memset(&r, 0, sizeof(LRANGE));
         curset = 0;
         for (from = cmdp->addr1.lno, to = cmdp->addr2.lno; from <= to; ++from) {
                 if (db_get(sp, from, DBG_FATAL, &p, &len))
@@ -156,9 +158,10 @@ shift(SCR *sp, EXCMD *cmdp, enum which rl)
                 /* Add the original line. */
                 memcpy(tbp, p + oldidx, len - oldidx);
 
-                /* Set the replacement line. */
-                if (db_set(sp, from, bp, (tbp + (len - oldidx)) - bp)) {
-err:                    FREE_SPACE(sp, bp, blen);
+                /* Stage the replacement line. */
+                if (db_rset(sp, &r, from, bp, (tbp + (len - oldidx)) - bp)) {
+err:                    db_rfree(&r);
+                        FREE_SPACE(sp, bp, blen);
                         return (1);
                 }
 
@@ -186,6 +189,10 @@ err:                    FREE_SPACE(sp, bp, blen);
                                 sp->cno -= oldidx - newidx;
                 }
         }
+        if (db_rcommit(sp, &r))
+                goto err;
+        db_rfree(&r);
+
         if (!curset) {
                 sp->lno = to;
                 sp->cno = 0;
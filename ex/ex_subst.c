@@ -32,10 +32,104 @@
 #define SUB_FIRST       0x01            /* The 'r' flag isn't reasonable. */
 #define SUB_MUSTSETR    0x02            /* The 'r' flag is required.      */
 
+/*
+ * Compiled RE's are cached, keyed by the converted pattern and the regcomp
+ * flags, so the search and substitute RE's can share one compiled copy, and
+ * patterns that alternate, or are recompiled after an option change, don't
+ * have to be compiled again.  The key covers the magic, ignorecase, iclower
+ * and extended options: magic is applied by the conversion, the rest turn
+ * into regcomp flags.  Entries are reference counted, and only unreferenced
+ * entries are reused, least recently used first.
+ */
+#define RE_CACHE        16              /* Cached RE's. */
+
+typedef struct {
+        char    *ptrn;                  /* Converted pattern. */
+        int      reflags;               /* Regcomp flags. */
+        regex_t  re;                    /* Compiled RE. */
+        size_t   ref;                   /* References. */
+        size_t   used;                  /* Last use. */
+} RECACHE;
+
+static RECACHE re_cache[RE_CACHE];
+static size_t  re_clock;
+
+/*
+ * The replacement is parsed once into a template of literal text, newlines,
+ * subexpressions and case conversions, which is kept until the replacement
+ * or the magic option changes.  A case conversion maps one character to one
+ * character, so the length of an expansion is known before it's done.
+ */
+enum rconv { RC_NONE, RC_LOWER, RC_ONELOWER, RC_ONEUPPER, RC_UPPER };
+
+typedef struct {
+        enum { R_TEXT, R_NEWLINE, R_SUB, R_CONV } type;
+        size_t   off;                   /* R_TEXT: offset in the text. */
+        size_t   len;                   /* R_TEXT: text length.        */
+        int      no;                    /* R_SUB: subexpression.       */
+        enum rconv conv;                /* R_CONV: conversion.         */
+        CHAR_T   ch;                    /* Character, if not R_TEXT.   */
+} RITEM;
+
+typedef struct {
+        char    *repl;                  /* Replacement.        */
+        size_t   repl_len;              /* Replacement length. */
+        int      magic;                 /* Magic option.       */
+        char    *text;                  /* Literal text.       */
+        size_t   tlen;                  /* Literal length.     */
+        RITEM   *item;                  /* Template items.     */
+        size_t   cnt;                   /* Template length.    */
+} RTMPL;
+
+static RTMPL re_tmpl;
+
+/*
+ * A substitute without the c flag, over more lines than make up a work unit,
+ * is done a batch of lines at a time.  The lines of a batch are matched and
+ * the new lines built in parallel, against the batch's copy of the lines,
+ * and the main thread then puts the changed lines into the file in order.
+ */
+typedef struct {
+        size_t   i;                     /* Line in the batch. */
+        size_t   off;                   /* New line offset in the unit. */
+        size_t   len;                   /* New line length. */
+        size_t   nl;                    /* First newline offset. */
+        size_t   nlcnt;                 /* Newlines in the new line. */
+        size_t   cno;                   /* Start of the last change. */
+} SLINE;
+
+typedef struct {
+        char    *lb;                    /* New lines, end to end. */
+        size_t   lbclen;                /* New lines length. */
+        size_t   lblen;                 /* New lines buffer size. */
+        size_t  *newl;                  /* Newline offsets. */
+        size_t   newl_cnt;              /* Newline offsets used. */
+        size_t   newl_len;              /* Newline array size. */
+        SLINE   *lines;                 /* Changed lines. */
+        size_t   lcnt;                  /* Changed lines used. */
+        size_t   lmax;                  /* Changed lines array size. */
+        int      eval;                  /* Error ending the unit, or 0. */
+} SUNIT;
+
+typedef struct {
+        SCR     *sp;                    /* Screen, only read.   */
+        LBATCH   b;                     /* Lines being changed. */
+        regex_t *re;                    /* Compiled RE.         */
+        RTMPL   *rt;                    /* Replacement.         */
+        SUNIT   *units;                 /* Work unit results.   */
+        size_t   umax;                  /* Allocated units.     */
+} SBATCH;
+
+static int re_cached(regex_t *, char *, int);
 static int re_conv(SCR *, char **, size_t *, int *);
-static int re_sub(SCR *, char *, char **, size_t *, size_t *, regmatch_t [10]);
+static RTMPL *re_repl(SCR *);
+static int re_sub(RTMPL *, char *, char **, size_t *, size_t *,
+    size_t **, size_t *, size_t *, regmatch_t [10]);
 static int re_tag_conv(SCR *, char **, size_t *, int *);
 static int s(SCR *, EXCMD *, char *, regex_t *, unsigned int);
+static int s_batch(SCR *, EXCMD *, regex_t *, RTMPL *, int, int, int, int *);
+static int s_copy(SUNIT *, char *, size_t);
+static int s_unit(void *, size_t);
 
 /*
  * ex_s --
@@ -147,7 +241,8 @@ subagain:       return (ex_subagain(sp, cmdp));
                  * Compile the RE.  Historic practice is that substitutes set
                  * the search direction as well as both substitute and search
                  * RE's.  We compile the RE twice, as we don't want to bother
-                 * ref counting the pattern string and (opaque) structure.
+                 * ref counting the pattern string, the second compile finds
+                 * the compiled RE in the cache.
                  */
                 if (re_compile(sp, ptrn, t - ptrn,
                     &sp->re, &sp->re_len, &sp->re_c, RE_C_SEARCH))
@@ -297,18 +392,6 @@ ex_subtilde(SCR *sp, EXCMD *cmdp)
  * when the replacement is done.  Don't change it unless you're *damned*
  * confident.
  */
-#define NEEDNEWLINE(sp) {                                               \
-        if ((sp)->newl_len == (sp)->newl_cnt) {                         \
-                (sp)->newl_len += 25;                                   \
-                REALLOCARRAY((sp), (sp)->newl,                          \
-                    (sp)->newl_len, sizeof(size_t));                    \
-                if ((sp)->newl == NULL) {                               \
-                        (sp)->newl_len = 0;                             \
-                        return (1);                                     \
-                }                                                       \
-        }                                                               \
-}
-
 #define BUILD(sp, l, len) {                                             \
         if (lbclen + (len) > lblen) {                                   \
                 lblen += MAXIMUM(lbclen + (len), 256);                  \
@@ -322,25 +405,15 @@ ex_subtilde(SCR *sp, EXCMD *cmdp)
         lbclen += (len);                                                \
 }
 
-#define NEEDSP(sp, len, pnt) {                                          \
-        if (lbclen + (len) > lblen) {                                   \
-                lblen += MAXIMUM(lbclen + (len), 256);                  \
-                REALLOC((sp), lb, lblen);                               \
-                if (lb == NULL) {                                       \
-                        lbclen = 0;                                     \
-                        return (1);                                     \
-                }                                                       \
-                (pnt) = lb + lbclen;                                    \
-        }                                                               \
-}
-
 static int
 s(SCR *sp, EXCMD *cmdp, char *s, regex_t *re, unsigned int flags)
 {
         EVENT ev;
+        LRANGE r;
         MARK from, to;
         TEXTH tiq;
         recno_t elno, lno, slno;
+        RTMPL *rt;
         regmatch_t match[10];
         size_t blen, cnt, last, lbclen, lblen, len, llen;
         size_t offset, saved_offset, scno;
@@ -482,6 +555,23 @@ noargs: if (F_ISSET(sp, SC_VI) && sp->c_suffix && (lflag || nflag || pflag)) {
         bp = lb = NULL;
         blen = lbclen = lblen = 0;
 
+        /*
+         * Without confirmation, the changed lines are staged and stored
+         * together, see db_rset.
+         */
+        memset(&r, 0, sizeof(LRANGE));
+
+        if ((rt = re_repl(sp)) == NULL)
+                goto err;
+
+        /* Big substitutes without confirmation are done in parallel. */
+        if (!sp->c_suffix && thread_count() > 1 &&
+            cmdp->addr2.lno - cmdp->addr1.lno >= THREAD_UNIT) {
+                if (s_batch(sp, cmdp, re, rt, lflag, nflag, pflag, &matched))
+                        goto err;
+                goto done;
+        }
+
         /* For each line... */
         for (matched = quit = 0, lno = cmdp->addr1.lno,
             elno = cmdp->addr2.lno; !quit && lno <= elno; ++lno) {
@@ -678,8 +768,11 @@ lquit:                          quit = 1;
 
                 /* Substitute the matching bytes. */
                 didsub = 1;
-                if (re_sub(sp, s, &lb, &lbclen, &lblen, match))
+                if (re_sub(rt, s, &lb, &lbclen, &lblen,
+                    &sp->newl, &sp->newl_cnt, &sp->newl_len, match)) {
+                        msgq(sp, M_SYSERR, NULL);
                         goto err;
+                }
 
                 /* Set the change flag so we know this line was modified. */
                 linechanged = 1;
@@ -792,7 +885,8 @@ endmatch:       if (!linechanged)
                 }
 
                 /* Store the changed line. */
-                if (db_set(sp, lno, lb + last, lbclen))
+                if (sp->c_suffix ? db_set(sp, lno, lb + last, lbclen) :
+                    db_rset(sp, &r, lno, lb + last, lbclen))
                         goto err;
 
                 /* Update changed line counter. */
@@ -808,6 +902,8 @@ endmatch:       if (!linechanged)
                  * lines.
                  */
                 if (lflag || nflag || pflag) {
+                        if (db_rcommit(sp, &r))
+                                goto err;
                         from.lno = to.lno = lno;
                         from.cno = to.cno = 0;
                         if (lflag)
@@ -835,6 +931,8 @@ endmatch:       if (!linechanged)
          * actually changed.  This prevents a screen flash if the user doesn't
          * change many of the possible lines.
          */
+done:   if (db_rcommit(sp, &r))
+                goto err;
         if (!sp->c_suffix && (sp->lno != slno || sp->cno != scno)) {
                 sp->cno = 0;
                 (void)nonblank(sp, sp->lno, &sp->cno);
@@ -854,15 +952,278 @@ endmatch:       if (!linechanged)
                 F_SET(cmdp, E_AUTOPRINT);
 
         if (0) {
-err:            rval = 1;
+                /* Keep the changes made before the error. */
+err:            (void)db_rcommit(sp, &r);
+                rval = 1;
         }
 
+        db_rfree(&r);
         if (bp != NULL)
                 FREE_SPACE(sp, bp, blen);
         free(lb);
         return (rval);
 }
 
+/*
+ * s_batch --
+ *      Do a substitution without confirmation a batch of lines at a time.
+ */
+static int
+s_batch(SCR *sp, EXCMD *cmdp, regex_t *re, RTMPL *rt,
+    int lflag, int nflag, int pflag, int *matchedp)
+{
+        LRANGE r;
+        MARK from, to;
+        SBATCH sb;
+        SLINE *slp;
+        SUNIT *up;
+        recno_t elno, lno, start;
+        size_t added, last, n, nunits;
+        int rval;
+        char *p;
+
+        memset(&r, 0, sizeof(LRANGE));
+        memset(&sb, 0, sizeof(sb));
+        sb.sp = sp;
+        sb.re = re;
+        sb.rt = rt;
+        *matchedp = rval = 0;
+        for (start = cmdp->addr1.lno,
+            elno = cmdp->addr2.lno; start <= elno; start += sb.b.cnt + added) {
+                /* Someone's unhappy, time to stop. */
+                if (INTERRUPTED(sp))
+                        break;
+
+                if (thread_batch(sp, &sb.b, start, elno))
+                        goto err;
+                if ((nunits = LBATCH_UNITS(&sb.b)) > sb.umax) {
+                        REALLOCARRAY(sp, sb.units, nunits, sizeof(SUNIT));
+                        if (sb.units == NULL) {
+                                sb.umax = 0;
+                                goto err;
+                        }
+                        memset(sb.units + sb.umax,
+                            0, (nunits - sb.umax) * sizeof(SUNIT));
+                        sb.umax = nunits;
+                }
+                thread_run(nunits, s_unit, &sb);
+
+                /*
+                 * Store the changed lines, and any lines split off them, in
+                 * order.  The lines of the batch move down by the number of
+                 * lines inserted before them.
+                 */
+                added = 0;
+                for (up = sb.units; up < sb.units + nunits; ++up) {
+                        for (slp = up->lines;
+                            slp < up->lines + up->lcnt; ++slp) {
+                                if (INTERRUPTED(sp))
+                                        goto done;
+
+                                lno = start + added + slp->i;
+                                *matchedp = 1;
+                                sp->lno = lno;
+                                sp->cno = slp->cno;
+
+                                p = up->lb + slp->off;
+                                for (last = 0, n = slp->nl;
+                                    n < slp->nl + slp->nlcnt;
+                                    ++n, ++lno, ++elno, ++added) {
+                                        if (db_insert(sp, lno, p + last,
+                                            up->newl[n] - slp->off - last))
+                                                goto err;
+                                        last = up->newl[n] - slp->off + 1;
+                                        ++sp->rptlines[L_ADDED];
+                                }
+                                if (db_rset(sp,
+                                    &r, lno, p + last, slp->len - last))
+                                        goto err;
+
+                                if (sp->rptlchange != lno) {
+                                        sp->rptlchange = lno;
+                                        ++sp->rptlines[L_CHANGED];
+                                }
+
+                                if (lflag || nflag || pflag) {
+                                        if (db_rcommit(sp, &r))
+                                                goto err;
+                                        from.lno = to.lno = lno;
+                                        from.cno = to.cno = 0;
+                                        if (lflag)
+                                                (void)ex_print(sp, cmdp,
+                                                    &from, &to, E_C_LIST);
+                                        if (nflag)
+                                                (void)ex_print(sp, cmdp,
+                                                    &from, &to, E_C_HASH);
+                                        if (pflag)
+                                                (void)ex_print(sp, cmdp,
+                                                    &from, &to, E_C_PRINT);
+                                }
+                        }
+                        if (up->eval != 0) {
+                                if (up->eval == REG_ESPACE)
+                                        msgq(sp, M_SYSERR, NULL);
+                                else
+                                        re_error(sp, up->eval, re);
+                                goto err;
+                        }
+                }
+        }
+
+        if (0) {
+err:            rval = 1;
+        }
+done:   if (db_rcommit(sp, &r))
+                rval = 1;
+        db_rfree(&r);
+        thread_bfree(&sb.b);
+        for (up = sb.units; up < sb.units + sb.umax; ++up) {
+                free(up->lb);
+                free(up->newl);
+                free(up->lines);
+        }
+        free(sb.units);
+        return (rval);
+}
+
+/*
+ * s_unit --
+ *      Match and build the changed lines of one work unit of a batch.  This
+ *      is the substitute loop of s(), without the confirmation.
+ */
+static int
+s_unit(void *arg, size_t unit)
+{
+        SBATCH *sb;
+        SCR *sp;
+        SLINE *slp;
+        SUNIT *up;
+        regmatch_t match[10];
+        size_t cno, i, j, len, llen, n, nl, offset, start;
+        int do_eol_match, eflags, eval, linechanged, nempty;
+        char *s;
+        void *tp;
+
+        sb = arg;
+        sp = sb->sp;
+        up = &sb->units[unit];
+        up->lbclen = up->newl_cnt = up->lcnt = 0;
+        up->eval = 0;
+
+        i = unit * THREAD_UNIT;
+        n = i + THREAD_UNIT > sb->b.cnt ? sb->b.cnt : i + THREAD_UNIT;
+        for (; i < n; ++i) {
+                /* Skip the lines that can't match. */
+                eval = regexec_lines(sb->re,
+                    sb->b.bp, sb->b.off + i, n - i, &j, 0);
+                if ((i += j) == n)
+                        break;
+                if (eval != 0)
+                        goto err;
+
+                if (up->lcnt == up->lmax) {
+                        if ((tp = openbsd_reallocarray(up->lines,
+                            up->lmax + 64, sizeof(SLINE))) == NULL)
+                                goto nomem;
+                        up->lines = tp;
+                        up->lmax += 64;
+                }
+
+                s = LBATCH_LINE(&sb->b, i);
+                llen = LBATCH_LEN(&sb->b, i);
+                start = up->lbclen;
+                nl = up->newl_cnt;
+                offset = cno = 0;
+                len = llen;
+                nempty = -1;
+                linechanged = 0;
+                do_eol_match = 1;
+                eflags = REG_STARTEND;
+                for (;;) {
+                        match[0].rm_so = offset;
+                        match[0].rm_eo = llen;
+                        eval = regexec(sb->re, s, 10, match, eflags);
+                        if (eval == REG_NOMATCH)
+                                break;
+                        if (eval != 0)
+                                goto err;
+                        eflags |= REG_NOTBOL;
+
+                        /* Ignore an empty match right after a match. */
+                        if (match[0].rm_so == nempty &&
+                            match[0].rm_eo == nempty) {
+                                nempty = -1;
+                                if (len == 0)
+                                        break;
+                                if (s_copy(up, s + offset, 1))
+                                        goto nomem;
+                                ++offset;
+                                --len;
+                                continue;
+                        }
+
+                        cno = match[0].rm_so;
+                        if (s_copy(up, s + offset, match[0].rm_so - offset) ||
+                            re_sub(sb->rt, s, &up->lb, &up->lbclen, &up->lblen,
+                            &up->newl, &up->newl_cnt, &up->newl_len, match))
+                                goto nomem;
+                        linechanged = 1;
+
+                        offset = match[0].rm_eo;
+                        len = llen - match[0].rm_eo;
+                        nempty = match[0].rm_eo;
+
+                        if (!sp->g_suffix || !do_eol_match)
+                                break;
+                        if (len == 0) {
+                                do_eol_match = 0;
+                                eflags |= REG_NOTEOL;
+                        }
+                }
+                if (!linechanged) {
+                        up->lbclen = start;
+                        up->newl_cnt = nl;
+                        continue;
+                }
+                if (len != 0 && s_copy(up, s + offset, len))
+                        goto nomem;
+
+                slp = &up->lines[up->lcnt++];
+                slp->i = i;
+                slp->off = start;
+                slp->len = up->lbclen - start;
+                slp->nl = nl;
+                slp->nlcnt = up->newl_cnt - nl;
+                slp->cno = cno;
+        }
+        return (0);
+
+nomem:  eval = REG_ESPACE;
+err:    up->eval = eval;
+        return (0);
+}
+
+/*
+ * s_copy --
+ *      Copy bytes into a work unit's new lines.
+ */
+static int
+s_copy(SUNIT *up, char *p, size_t len)
+{
+        void *tp;
+
+        if (up->lbclen + len > up->lblen) {
+                if ((tp = realloc(up->lb,
+                    up->lblen + MAXIMUM(up->lbclen + len, 256))) == NULL)
+                        return (1);
+                up->lb = tp;
+                up->lblen += MAXIMUM(up->lbclen + len, 256);
+        }
+        memcpy(up->lb + up->lbclen, p, len);
+        up->lbclen += len;
+        return (0);
+}
+
 /*
  * re_compile --
  *      Compile the RE.
@@ -895,12 +1256,14 @@ re_compile(SCR *sp, char *ptrn, size_t plen, char **ptrnp, size_t *lenp,
         }
 
         /* If we're replacing a saved value, clear the old one. */
+        if (LF_ISSET(RE_C_SEARCH))
+                search_ifree(sp);
         if (LF_ISSET(RE_C_SEARCH) && F_ISSET(sp, SC_RE_SEARCH)) {
-                regfree(&sp->re_c);
+                re_free(&sp->re_c);
                 F_CLR(sp, SC_RE_SEARCH);
         }
         if (LF_ISSET(RE_C_SUBST) && F_ISSET(sp, SC_RE_SUBST)) {
-                regfree(&sp->subre_c);
+                re_free(&sp->subre_c);
                 F_CLR(sp, SC_RE_SUBST);
         }
 
@@ -951,7 +1314,7 @@ re_compile(SCR *sp, char *ptrn, size_t plen, char **ptrnp, size_t *lenp,
          * Regcomp isn't 8-bit clean, so we just lost if the pattern
          * contained a NULL.  Bummer!
          */
-        if ((rval = regcomp(rep, ptrn, /* plen, */ reflags)) != 0) {
+        if ((rval = re_cached(rep, ptrn, /* plen, */ reflags)) != 0) {
                 if (!LF_ISSET(RE_C_SILENT))
                         re_error(sp, rval, rep);
                 return (1);
@@ -965,6 +1328,66 @@ re_compile(SCR *sp, char *ptrn, size_t plen, char **ptrnp, size_t *lenp,
         return (0);
 }
 
+/*
+ * re_cached --
+ *      Compile an RE, or take a reference to a cached copy.
+ */
+static int
+re_cached(regex_t *rep, char *ptrn, int reflags)
+{
+        RECACHE *lru, *rc;
+        int rval;
+        char *p;
+
+        for (lru = NULL, rc = re_cache; rc < re_cache + RE_CACHE; ++rc) {
+                if (rc->ptrn != NULL &&
+                    rc->reflags == reflags && !strcmp(rc->ptrn, ptrn)) {
+                        ++rc->ref;
+                        rc->used = ++re_clock;
+                        *rep = rc->re;
+                        return (0);
+                }
+                if (rc->ref == 0 && (lru == NULL || rc->used < lru->used))
+                        lru = rc;
+        }
+
+        if ((rval = regcomp(rep, ptrn, reflags)) != 0)
+                return (rval);
+
+        /* If every entry is in use, or out of memory, don't cache it. */
+        if (lru == NULL || (p = strdup(ptrn)) == NULL)
+                return (0);
+        if (lru->ptrn != NULL) {
+                free(lru->ptrn);
+                regfree(&lru->re);
+        }
+        lru->ptrn = p;
+        lru->reflags = reflags;
+        lru->re = *rep;
+        lru->ref = 1;
+        lru->used = ++re_clock;
+        return (0);
+}
+
+/*
+ * re_free --
+ *      Release an RE compiled by re_compile.
+ *
+ * PUBLIC: void re_free(regex_t *);
+ */
+void
+re_free(regex_t *rep)
+{
+        RECACHE *rc;
+
+        for (rc = re_cache; rc < re_cache + RE_CACHE; ++rc)
+                if (rc->ref != 0 && rc->re.re_g == rep->re_g) {
+                        --rc->ref;
+                        return;
+                }
+        regfree(rep);
+}
+
 /*
  * re_conv --
  *      Convert vi's regular expressions into something that the
@@ -1200,26 +1623,46 @@ re_error(SCR *sp, int errcode, regex_t *preg)
 }
 
 /*
- * re_sub --
- *      Do the substitution for a regular expression.
+ * re_repl --
+ *      Return the template of the replacement, parsing it if it's changed.
  */
-static int
-re_sub(SCR *sp, char *ip, char **lbp, size_t *lbclenp, size_t *lblenp,
-    regmatch_t match[10])
+static RTMPL *
+re_repl(SCR *sp)
 {
-        enum { C_NOTSET, C_LOWER, C_ONELOWER, C_ONEUPPER, C_UPPER } conv;
-        size_t lbclen, lblen;           /* Local copies. */
-        size_t mlen;                    /* Match length. */
-        size_t rpl;                     /* Remaining replacement length. */
-        char *rp;                       /* Replacement pointer. */
-        int ch;
-        int no;                         /* Match replacement offset. */
-        char *p, *t;                    /* Buffer pointers. */
-        char *lb;                       /* Local copies. */
-
-        lb = *lbp;                      /* Get local copies. */
-        lbclen = *lbclenp;
-        lblen = *lblenp;
+        RTMPL *rt;
+        RITEM *ip;
+        enum rconv conv;
+        size_t rpl;
+        unsigned int value;
+        int magic, no;
+        CHAR_T ch;
+        char *rp;
+
+        rt = &re_tmpl;
+        magic = O_ISSET(sp, O_MAGIC) ? 1 : 0;
+        if (rt->repl != NULL && rt->magic == magic &&
+            rt->repl_len == sp->repl_len && (sp->repl_len == 0 ||
+            memcmp(rt->repl, sp->repl, sp->repl_len) == 0))
+                return (rt);
+
+        free(rt->repl);
+        free(rt->text);
+        free(rt->item);
+        memset(rt, 0, sizeof(RTMPL));
+        MALLOC(sp, rt->text, sp->repl_len + 1);
+        MALLOC(sp, rt->item, (sp->repl_len + 1) * sizeof(RITEM));
+        MALLOC(sp, rt->repl, sp->repl_len + 1);
+        if (rt->text == NULL || rt->item == NULL || rt->repl == NULL) {
+                free(rt->repl);
+                free(rt->text);
+                free(rt->item);
+                memset(rt, 0, sizeof(RTMPL));
+                return (NULL);
+        }
+        if (sp->repl_len != 0)
+                memcpy(rt->repl, sp->repl, sp->repl_len);
+        rt->repl_len = sp->repl_len;
+        rt->magic = magic;
 
         /*
          * QUOTING NOTE:
@@ -1237,42 +1680,12 @@ re_sub(SCR *sp, char *ip, char **lbp, size_t *lbclenp, size_t *lblenp,
          *
          * Otherwise, since this is the lowest level of replacement, discard
          * all escaping characters.  This (hopefully) matches historic practice.
+         * A subexpression that didn't match is replaced by its digit.
          */
-#define OUTCH(ch, nltrans) {                                            \
-        CHAR_T __ch = (ch);                                             \
-        unsigned int __value = KEY_VAL(sp, __ch);                       \
-        if ((nltrans) && (__value == K_CR || __value == K_NL)) {        \
-                NEEDNEWLINE(sp);                                        \
-                sp->newl[sp->newl_cnt++] = lbclen;                      \
-        } else if (conv != C_NOTSET) {                                  \
-                switch (conv) {                                         \
-                case C_ONELOWER:                                        \
-                        conv = C_NOTSET;                                \
-                        /* FALLTHROUGH */                               \
-                case C_LOWER:                                           \
-                        if (isupper(__ch))                              \
-                                __ch = tolower(__ch);                   \
-                        break;                                          \
-                case C_ONEUPPER:                                        \
-                        conv = C_NOTSET;                                \
-                        /* FALLTHROUGH */                               \
-                case C_UPPER:                                           \
-                        if (islower(__ch))                              \
-                                __ch = toupper(__ch);                   \
-                        break;                                          \
-                default:                                                \
-                        abort();                                        \
-                }                                                       \
-        }                                                               \
-        NEEDSP(sp, 1, p);                                               \
-        *p++ = __ch;                                                    \
-        ++lbclen;                                                       \
-}
-        conv = C_NOTSET;
-        for (rp = sp->repl, rpl = sp->repl_len, p = lb + lbclen; rpl--;) {
+        for (rp = rt->repl, rpl = rt->repl_len; rpl--;) {
                 switch (ch = *rp++) {
                 case '&':
-                        if (O_ISSET(sp, O_MAGIC)) {
+                        if (magic) {
                                 no = 0;
                                 goto subzero;
                         }
@@ -1284,7 +1697,7 @@ re_sub(SCR *sp, char *ip, char **lbp, size_t *lbclenp, size_t *lblenp,
                         switch (ch = *rp) {
                         case '&':
                                 ++rp;
-                                if (!O_ISSET(sp, O_MAGIC)) {
+                                if (!magic) {
                                         no = 0;
                                         goto subzero;
                                 }
@@ -1292,44 +1705,166 @@ re_sub(SCR *sp, char *ip, char **lbp, size_t *lbclenp, size_t *lblenp,
                         case '0': case '1': case '2': case '3': case '4':
                         case '5': case '6': case '7': case '8': case '9':
                                 no = *rp++ - '0';
-subzero:                        if (match[no].rm_so == -1 ||
-                                    match[no].rm_eo == -1)
-                                        break;
-                                mlen = match[no].rm_eo - match[no].rm_so;
-                                for (t = ip + match[no].rm_so; mlen--; ++t)
-                                        OUTCH(*t, 0);
+subzero:                        ip = &rt->item[rt->cnt++];
+                                ip->type = R_SUB;
+                                ip->no = no;
+                                ip->ch = ch;
                                 continue;
                         case 'e':
                         case 'E':
-                                ++rp;
-                                conv = C_NOTSET;
-                                continue;
+                                conv = RC_NONE;
+                                goto conv;
                         case 'l':
-                                ++rp;
-                                conv = C_ONELOWER;
-                                continue;
+                                conv = RC_ONELOWER;
+                                goto conv;
                         case 'L':
-                                ++rp;
-                                conv = C_LOWER;
-                                continue;
+                                conv = RC_LOWER;
+                                goto conv;
                         case 'u':
-                                ++rp;
-                                conv = C_ONEUPPER;
-                                continue;
+                                conv = RC_ONEUPPER;
+                                goto conv;
                         case 'U':
-                                ++rp;
-                                conv = C_UPPER;
+                                conv = RC_UPPER;
+conv:                           ++rp;
+                                ip = &rt->item[rt->cnt++];
+                                ip->type = R_CONV;
+                                ip->conv = conv;
                                 continue;
                         default:
                                 ++rp;
                                 break;
                         }
                 }
-                OUTCH(ch, 1);
+                value = KEY_VAL(sp, ch);
+                if (value == K_CR || value == K_NL) {
+                        ip = &rt->item[rt->cnt++];
+                        ip->type = R_NEWLINE;
+                        ip->ch = ch;
+                        continue;
+                }
+                if (rt->cnt == 0 || rt->item[rt->cnt - 1].type != R_TEXT) {
+                        ip = &rt->item[rt->cnt++];
+                        ip->type = R_TEXT;
+                        ip->off = rt->tlen;
+                        ip->len = 0;
+                } else
+                        ip = &rt->item[rt->cnt - 1];
+                rt->text[rt->tlen++] = ch;
+                ++ip->len;
         }
+        return (rt);
+}
 
-        *lbp = lb;                      /* Update caller's information. */
-        *lbclenp = lbclen;
-        *lblenp = lblen;
+/*
+ * re_sub --
+ *      Expand the replacement template for a match into the build buffer,
+ *      adding the offsets of any newlines to the newline array.  Both are
+ *      grown, at most once, before the expansion.  The substitute threads
+ *      call this routine, so on failure it returns 1 without a message.
+ */
+static int
+re_sub(RTMPL *rt, char *ip, char **lbp, size_t *lbclenp, size_t *lblenp,
+    size_t **newlp, size_t *newl_cntp, size_t *newl_lenp,
+    regmatch_t match[10])
+{
+        enum rconv conv;
+        RITEM *item, *eitem;
+        size_t len, nlen, nnl;
+        CHAR_T ch;
+        char *p, *t;
+        void *tp;
+
+        eitem = rt->item + rt->cnt;
+        for (len = nnl = 0, item = rt->item; item < eitem; ++item)
+                switch (item->type) {
+                case R_TEXT:
+                        len += item->len;
+                        break;
+                case R_NEWLINE:
+                        ++len;
+                        ++nnl;
+                        break;
+                case R_SUB:
+                        if (match[item->no].rm_so == -1 ||
+                            match[item->no].rm_eo == -1)
+                                ++len;
+                        else
+                                len += match[item->no].rm_eo -
+                                    match[item->no].rm_so;
+                        break;
+                case R_CONV:
+                        break;
+                }
+        if (*lbclenp + len > *lblenp) {
+                nlen = *lblenp + MAXIMUM(*lbclenp + len, 256);
+                if ((tp = realloc(*lbp, nlen)) == NULL)
+                        return (1);
+                *lbp = tp;
+                *lblenp = nlen;
+        }
+        if (*newl_cntp + nnl > *newl_lenp) {
+                nlen = *newl_lenp + MAXIMUM(nnl, 25);
+                if ((tp = openbsd_reallocarray(*newlp,
+                    nlen, sizeof(size_t))) == NULL)
+                        return (1);
+                *newlp = tp;
+                *newl_lenp = nlen;
+        }
+
+        conv = RC_NONE;
+        for (p = *lbp + *lbclenp, item = rt->item; item < eitem; ++item) {
+                switch (item->type) {
+                case R_TEXT:
+                        t = rt->text + item->off;
+                        len = item->len;
+                        break;
+                case R_NEWLINE:
+                        (*newlp)[(*newl_cntp)++] = p - *lbp;
+                        *p++ = item->ch;
+                        continue;
+                case R_SUB:
+                        if (match[item->no].rm_so == -1 ||
+                            match[item->no].rm_eo == -1) {
+                                t = (char *)&item->ch;
+                                len = 1;
+                        } else {
+                                t = ip + match[item->no].rm_so;
+                                len = match[item->no].rm_eo -
+                                    match[item->no].rm_so;
+                        }
+                        break;
+                case R_CONV:
+                        conv = item->conv;
+                        continue;
+                }
+                if (conv == RC_NONE) {
+                        memcpy(p, t, len);
+                        p += len;
+                        continue;
+                }
+                for (; len > 0; --len) {
+                        ch = *t++;
+                        switch (conv) {
+                        case RC_NONE:
+                                break;
+                        case RC_ONELOWER:
+                                conv = RC_NONE;
+                                /* FALLTHROUGH */
+                        case RC_LOWER:
+                                if (isupper(ch))
+                                        ch = tolower(ch);
+                                break;
+                        case RC_ONEUPPER:
+                                conv = RC_NONE;
+                                /* FALLTHROUGH */
+                        case RC_UPPER:
+                                if (islower(ch))
+                                        ch = toupper(ch);
+                                break;
+                        }
+                        *p++ = ch;
+                }
+        }
+        *lbclenp = p - *lbp;
         return (0);
 }
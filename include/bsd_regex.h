@@ -95,6 +95,7 @@ typedef struct {
 # define REG_EMPTY      14
 # define REG_ASSERT     15
 # define REG_INVARG     16
+# define REG_ECOMPLEX   17
 # define REG_ATOI       255     /* convert name to number (!) */
 # define REG_ITOA       0400    /* convert number to name (!) */
 
@@ -109,11 +110,17 @@ typedef struct {
 # define regcomp        openbsd_regcomp
 # define regerror       openbsd_regerror
 # define regexec        openbsd_regexec
+# define regexec_last   openbsd_regexec_last
+# define regexec_lines  openbsd_regexec_lines
 # define regfree        openbsd_regfree
 
 int     regcomp(regex_t *, const char *, int);
 size_t  regerror(int, const regex_t *, char *, size_t);
 int     regexec(const regex_t *, const char *, size_t, regmatch_t [], int);
+int     regexec_last(const regex_t *, const char *, size_t, regmatch_t [],
+            int, regoff_t);
+int     regexec_lines(const regex_t *, const char *, const size_t *, size_t,
+            size_t *, int);
 void    regfree(regex_t *);
 
 #endif /* !_REGEX_H_ */
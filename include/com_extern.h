@@ -65,6 +65,12 @@ int db_delete(SCR *, recno_t);
 int db_append(SCR *, int, recno_t, char *, size_t);
 int db_insert(SCR *, recno_t, char *, size_t);
 int db_set(SCR *, recno_t, char *, size_t);
+int db_move(SCR *, recno_t, recno_t, recno_t);
+int db_rset(SCR *, LRANGE *, recno_t, char *, size_t);
+int db_rdelete(SCR *, LRANGE *, recno_t);
+int db_rcommit(SCR *, LRANGE *);
+void db_rfree(LRANGE *);
+int db_radd(SCR *, LRANGE *, recno_t, unsigned int, char *, size_t);
 int db_exist(SCR *, recno_t);
 int db_last(SCR *, recno_t *);
 void db_err(SCR *, recno_t);
@@ -73,6 +79,8 @@ int log_end(SCR *, EXF *);
 int log_cursor(SCR *);
 int log_line(SCR *, recno_t, unsigned int);
 int log_mark(SCR *, LMARK *);
+int log_move(SCR *, recno_t, recno_t, recno_t);
+int log_range(SCR *, LRANGE *);
 int log_backward(SCR *, MARK *);
 int log_setline(SCR *);
 int log_forward(SCR *, MARK *);
@@ -82,6 +90,8 @@ int mark_init(SCR *, EXF *);
 int mark_end(SCR *, EXF *);
 int mark_get(SCR *, CHAR_T, MARK *, mtype_t);
 int mark_set(SCR *, CHAR_T, MARK *, int);
+recno_t mark_lno(SCR *, LMARK *);
+int mark_setlno(SCR *, LMARK *, recno_t);
 int mark_insdel(SCR *, lnop_t, recno_t);
 void msgq(SCR *, mtype_t, const char *, ...);
 void msgq_str(SCR *, mtype_t, char *, char *);
@@ -125,6 +135,10 @@ int screen_end(SCR *);
 SCR *screen_next(SCR *);
 int f_search(SCR *, MARK *, MARK *, char *, size_t, char **, unsigned int);
 int b_search(SCR *, MARK *, MARK *, char *, size_t, char **, unsigned int);
+int search_index(SCR *, recno_t);
+int search_idle(SCR *);
+void search_insdel(SCR *, lnop_t, recno_t);
+void search_ifree(SCR *);
 void search_busy(SCR *, busy_t);
 int seq_set(SCR *, CHAR_T *,
 size_t, CHAR_T *, size_t, CHAR_T *, size_t, seq_t, int);
@@ -136,6 +150,11 @@ void seq_close(GS *);
 int seq_dump(SCR *, seq_t, int);
 int seq_save(SCR *, FILE *, char *, seq_t);
 int e_memcmp(CHAR_T *, EVENT *, size_t);
+int thread_count(void);
+void thread_run(size_t, int (*)(void *, size_t), void *);
+size_t thread_first(size_t, int (*)(void *, size_t), void *);
+int thread_batch(SCR *, LBATCH *, recno_t, recno_t);
+void thread_bfree(LBATCH *);
 void *binc(SCR *, void *, size_t *, size_t);
 int nonblank(SCR *, recno_t, size_t *);
 CHAR_T *v_strdup(SCR *, const CHAR_T *, size_t);
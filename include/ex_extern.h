@@ -67,6 +67,9 @@ int ex_file(SCR *, EXCMD *);
 int ex_filter(SCR *, EXCMD *, MARK *, MARK *, MARK *, char *, enum filtertype);
 int ex_global(SCR *, EXCMD *);
 int ex_v(SCR *, EXCMD *);
+int ex_g_add(SCR *, RANGE *, recno_t);
+int ex_g_next(RANGE *, recno_t *);
+void ex_g_free(RANGE *);
 int ex_g_insdel(SCR *, lnop_t, recno_t);
 int ex_screen_copy(SCR *, SCR *);
 int ex_screen_end(SCR *);
@@ -118,6 +121,7 @@ int ex_s(SCR *, EXCMD *);
 int ex_subagain(SCR *, EXCMD *);
 int ex_subtilde(SCR *, EXCMD *);
 int re_compile(SCR *, char *, size_t, char **, size_t *, regex_t *, unsigned int);
+void re_free(regex_t *);
 void re_error(SCR *, int, regex_t *);
 int ex_tag_first(SCR *, char *);
 int ex_tag_push(SCR *, EXCMD *);
@@ -145,6 +145,7 @@ int vs_crel(SCR *, long);
 int v_zexit(SCR *, VICMD *);
 int vi(SCR **);
 int vs_line(SCR *, SMAP *, size_t *, size_t *);
+void vs_rowmove(SCR *, size_t, long);
 int vs_number(SCR *);
 void vs_busy(SCR *, const char *, busy_t);
 void vs_home(SCR *);
@@ -157,9 +158,14 @@ int vs_refresh(SCR *, int);
 int vs_column(SCR *, size_t *);
 size_t vs_screens(SCR *, recno_t, size_t *);
 size_t vs_columns(SCR *, char *, recno_t, size_t *, size_t *);
+size_t *vs_ckpt(SCR *, VLAY *, char *, size_t, size_t, int);
 size_t vs_rcm(SCR *, recno_t, int);
 size_t vs_colpos(SCR *, recno_t, size_t);
+VLAY *vs_layout(SCR *, recno_t, int);
+void vs_layout_insdel(SCR *, lnop_t, recno_t);
 int vs_change(SCR *, recno_t, lnop_t);
+void vs_bulk(SCR *, int);
+void vs_bulk_flush(GS *);
 int vs_sm_fill(SCR *, recno_t, pos_t);
 int vs_sm_scroll(SCR *, MARK *, recno_t, scroll_t);
 int vs_sm_1up(SCR *);
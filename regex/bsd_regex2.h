@@ -139,6 +139,23 @@ CHIN(const cset *cs, char c)
   return ( cs->ptr[(uch)c] & cs->mask ) != 0;
 }
 
+/*
+ * Bit-parallel (Shift-And) form of an RE that is just a sequence of
+ * characters, []'s and .'s, each possibly followed by *, + or ?, and that
+ * can't match the empty string.  Item i of the sequence is bit i of a state
+ * word, which is on when the item is one of those to be matched next; the
+ * bit after the last item is on when a match is complete.
+ */
+struct bitpar
+{
+  unsigned long chars[NC]; /* items each character matches */
+  unsigned long loop;      /* items that can repeat (* and +) */
+  unsigned long skip;      /* items that can be skipped (* and ?) */
+  unsigned long init;      /* state before any characters */
+  unsigned long last;      /* the match-complete bit */
+  int nskip;               /* longest run of skippable items */
+};
+
 /*
  * main compiled-expression structure
  */
@@ -163,6 +180,11 @@ struct re_guts
   int neol;         /* number of $ used */
   char *must;       /* match must contain this string */
   int mlen;         /* length of must */
+  int mstart;       /* does every match start with must? */
+  int literal;      /* is the RE just the must string? */
+  unsigned long id; /* tells compiled RE's apart, for DFA caches */
+  struct bitpar *bitpar; /* bit-parallel form, if it has one */
+  uch *fold;        /* REG_ICASE input folding table, or NULL */
   size_t nsub;      /* copy of re_nsub */
   int backrefs;     /* does it use back references? */
   sopno nplus;      /* how deep does it nest +s? */
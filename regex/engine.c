@@ -56,11 +56,30 @@
 # define slow sslow
 # define dissect sdissect
 # define backref sbackref
+# define backtrack sbacktrack
 # define step sstep
 # define print sprint
 # define at sat
 # define match smat
 # define nope snope
+# define mustfind smustfind
+# define dfa sdfa
+# define dfastate sdfastate
+# define dfaget sdfaget
+# define dfafast sdfafast
+# define dfaslow sdfaslow
+# define dfastep sdfastep
+# define dfaintern sdfaintern
+# define dfaflush sdfaflush
+# define dfafree sdfafree
+# define dfakeyinit sdfakeyinit
+# define dfakey sdfakey
+# define dfaonce sdfaonce
+# define dfakeyok sdfakeyok
+# define backstack sbackstack
+# define backinit sbackinit
+# define backonce sbackonce
+# define backbytes sbackbytes
 #endif /* ifdef SNAMES */
 #ifdef LNAMES
 # define matcher lmatcher
@@ -68,11 +87,30 @@
 # define slow lslow
 # define dissect ldissect
 # define backref lbackref
+# define backtrack lbacktrack
 # define step lstep
 # define print lprint
 # define at lat
 # define match lmat
 # define nope lnope
+# define mustfind lmustfind
+# define dfa ldfa
+# define dfastate ldfastate
+# define dfaget ldfaget
+# define dfafast ldfafast
+# define dfaslow ldfaslow
+# define dfastep ldfastep
+# define dfaintern ldfaintern
+# define dfaflush ldfaflush
+# define dfafree ldfafree
+# define dfakeyinit ldfakeyinit
+# define dfakey ldfakey
+# define dfaonce ldfaonce
+# define dfakeyok ldfakeyok
+# define backstack lbackstack
+# define backinit lbackinit
+# define backonce lbackonce
+# define backbytes lbackbytes
 #endif /* ifdef LNAMES */
 
 /* another structure passed up and down to avoid zillions of parameters */
@@ -86,6 +124,9 @@ struct match
   const char *endp;     /* end of string -- virtual NUL here */
   const char *coldp;    /* can be no match starting before here */
   const char **lastpos; /* [nplus+1] */
+  long work;            /* backtracking steps left */
+  uintptr_t stack;      /* where the backtracking stack starts */
+  size_t stackmax;      /* backtracking stack bytes allowed */
   STATEVARS;
   states st;    /* current states */
   states fresh; /* states for a fresh start */
@@ -98,13 +139,19 @@ static const char *dissect(struct match *, const char *, const char *, sopno,
                            sopno);
 static const char *backref(struct match *, const char *, const char *, sopno,
                            sopno, sopno, int);
+static const char *backtrack(struct match *, const char *, const char *,
+                             sopno, sopno, sopno, int);
 static const char *fast(struct match *, const char *, const char *, sopno,
                         sopno);
 static const char *slow(struct match *, const char *, const char *, sopno,
                         sopno);
 static states step(struct re_guts *, sopno, sopno, states, int, states);
+static const char *mustfind(struct re_guts *, const char *, const char *);
 
 #define MAX_RECURSION 100
+#define MAX_BACKWORK ( 1L << 24 ) /* backtracking steps per call */
+#define MAX_BACKSTACK ( 8L * 1024 * 1024 ) /* worker thread stack size */
+#define BACKSTACK_SLACK ( 256L * 1024 )    /* stack left for the callers */
 #define BOL ( OUT + 1 )
 #define EOL ( BOL + 1 )
 #define BOLEOL ( BOL + 2 )
@@ -117,6 +164,75 @@ static states step(struct re_guts *, sopno, sopno, states, int, states);
 #define NONCHAR(c) (( c ) > CHAR_MAX )
 #define NNONCHAR ( CODEMAX - CHAR_MAX )
 
+/* a character as the engine sees it, folded if REG_ICASE */
+#define FOLD(g, c)                                                            \
+  (( g )->fold != NULL ? (char)( g )->fold[(uch)( c )] : (char)( c ))
+
+/*
+ * Stepping the NFA costs a pass over every state for every character.
+ * Instead, fast() and slow() run a DFA whose states are the NFA's state
+ * sets, built lazily as strings are scanned: each new state set is kept,
+ * and the transitions out of it are filled in the first time they're
+ * taken.  The DFA belongs to the calling thread, so threads searching with
+ * the same RE don't have to lock anything, and it's kept until the thread
+ * uses a different RE.  If the DFA outgrows DFA_MAXMEM it's thrown away and
+ * the NFA finishes the call; after DFA_FLUSHES of those, the NFA is used
+ * for the RE from then on.
+ */
+#ifndef DFA_MAXMEM
+# define DFA_MAXMEM ( 1024 * 1024 ) /* bytes of DFA states per thread */
+# define DFA_HASH 509               /* DFA state hash table size */
+# define DFA_FLUSHES 8              /* times the DFA can outgrow its space */
+# define DFA_FAST 0                 /* a fast() transition */
+# define DFA_SLOW 1                 /* a slow() transition */
+# define DFA_FLAG 2                 /* a BOL, EOL, BOW or EOW step */
+#endif /* ifndef DFA_MAXMEM */
+
+struct dfastate
+{
+  struct dfastate *hnext;           /* hash chain */
+  struct dfastate *fnext[NC];       /* fast() transitions, by char */
+  struct dfastate *snext[NC];       /* slow() transitions, by char */
+  struct dfastate *flag[NNONCHAR];  /* BOL etc. steps, by code - OUT */
+  unsigned int hash;                /* hash of set */
+  int fresh;                        /* same as a fresh start? */
+  int empty;                        /* no states at all? */
+  int stop;                         /* includes the stop state? */
+  states set;                       /* the state set */
+};
+
+struct dfa
+{
+  struct re_guts *g;                /* the RE */
+  unsigned long id;                 /* and its id */
+  struct dfastate *hash[DFA_HASH];  /* the states */
+  struct dfastate *start;           /* the fresh start state */
+  size_t mem;                       /* bytes used by the states */
+  int flushes;                      /* times it outgrew DFA_MAXMEM */
+};
+
+static struct dfa *dfaget(struct match *);
+static int dfafast(struct match *, struct dfa *, const char *, const char *,
+                   const char **);
+static int dfaslow(struct match *, struct dfa *, const char *, const char *,
+                   const char **);
+static struct dfastate *dfastep(struct match *, struct dfa *,
+                                struct dfastate *, int, int);
+static struct dfastate *dfaintern(struct match *, struct dfa *, states);
+static void dfaflush(struct dfa *);
+static void dfafree(void *);
+static void dfakeyinit(void);
+
+static pthread_key_t dfakey;
+static pthread_once_t dfaonce = PTHREAD_ONCE_INIT;
+static int dfakeyok;
+
+static size_t backstack(void);
+static void backinit(void);
+
+static pthread_once_t backonce = PTHREAD_ONCE_INIT;
+static size_t backbytes;
+
 #ifdef REDEBUG
 static void print(struct match *, const char *, states, int, FILE *);
 #endif /* ifdef REDEBUG */
@@ -185,21 +301,9 @@ matcher(struct re_guts *g, const char *string, size_t nmatch,
     }
 
   /* prescreening; this does wonders for this rather slow code */
-  if (g->must != NULL)
+  if (g->must != NULL && mustfind(g, start, stop) == NULL)
     {
-      for (dp = start; dp < stop; dp++)
-        {
-          if (*dp == g->must[0] && stop - dp >= g->mlen
-              && memcmp(dp, g->must, g->mlen) == 0)
-            {
-              break;
-            }
-        }
-
-      if (dp == stop) /* we didn't find g->must */
-        {
-          return REG_NOMATCH;
-        }
+      return REG_NOMATCH; /* we didn't find g->must */
     }
 
   /* match struct setup */
@@ -207,6 +311,9 @@ matcher(struct re_guts *g, const char *string, size_t nmatch,
   m->eflags = eflags;
   m->pmatch = NULL;
   m->lastpos = NULL;
+  m->work = MAX_BACKWORK;
+  m->stack = (uintptr_t)&mv;
+  m->stackmax = g->backrefs ? backstack() : 0;
   m->offp = string;
   m->beginp = start;
   m->endp = stop;
@@ -306,12 +413,13 @@ matcher(struct re_guts *g, const char *string, size_t nmatch,
       assert(g->nplus == 0 || m->lastpos != NULL);
       for (;;)
         {
-          if (dp != NULL || endp <= m->coldp)
+          if (dp != NULL || endp <= m->coldp || m->work < 0)
             {
               break; /* defeat */
             }
 
           NOTE("backoff");
+          m->work -= endp - m->coldp;
           endp = slow(m, m->coldp, endp - 1, gf, gl);
           if (endp == NULL)
             {
@@ -337,8 +445,18 @@ matcher(struct re_guts *g, const char *string, size_t nmatch,
           break;
         }
 
+      /* too much work to tell, give up rather than take forever */
+      if (m->work < 0)
+        {
+          free(m->pmatch);
+          free(m->lastpos);
+          STATETEARDOWN(m);
+          return REG_ECOMPLEX;
+        }
+
       /* despite initial appearances, there is no match here */
       NOTE("false alarm");
+      m->work -= stop - m->coldp;
       if (m->coldp == stop)
         {
           break;
@@ -616,10 +734,34 @@ dissect(struct match *m, const char *start, const char *stop, sopno startst,
 
 /*
  * - backref - figure out what matched what, figuring in back references
+ *
+ * Backtracking can take exponential time, and recurses about once per
+ * character, so the work and the stack it uses are limited.  If either
+ * runs out, the work count goes negative and the match fails all the way
+ * up, and matcher() reports REG_ECOMPLEX.
  */
 static const char * /* == stop (success) or NULL (failure) */
 backref(struct match *m, const char *start, const char *stop, sopno startst,
         sopno stopst, sopno lev, int rec)  /* PLUS nesting level */
+{
+  uintptr_t here = (uintptr_t)&here;
+
+  if (--m->work < 0
+      || ( here < m->stack ? m->stack - here : here - m->stack ) > m->stackmax)
+    {
+      m->work = -1;
+      return NULL;
+    }
+
+  return backtrack(m, start, stop, startst, stopst, lev, rec);
+}
+
+/*
+ * - backtrack - backref(), without the limits
+ */
+static const char * /* == stop (success) or NULL (failure) */
+backtrack(struct match *m, const char *start, const char *stop,
+          sopno startst, sopno stopst, sopno lev, int rec)
 {
   int i;
   sopno ss;        /* start sop of current subRE */
@@ -644,11 +786,13 @@ backref(struct match *m, const char *start, const char *stop, sopno startst,
       switch (OP(s = m->g->strip[ss]))
         {
         case OCHAR:
-          if (sp == stop || *sp++ != (char)OPND(s))
+          if (sp == stop || FOLD(m->g, *sp) != (char)OPND(s))
             {
               return NULL;
             }
 
+          sp++;
+
           break;
 
         case OANY:
@@ -910,6 +1054,86 @@ backref(struct match *m, const char *start, const char *stop, sopno startst,
   return NULL;
 }
 
+/*
+ * - mustfind - find the first copy of g->must in a string
+ *
+ * Let memchr(3) find candidates for the first character, it's much faster
+ * than a loop, and check the last character before comparing the rest.
+ * With REG_ICASE the must string is folded, so the string has to be too.
+ */
+static const char * /* where it starts, or NULL */
+mustfind(struct re_guts *g, const char *start, const char *stop)
+{
+  const char *dp;
+  const char *last; /* last place it could start */
+  const char c = g->must[0];
+  const char lc = g->must[g->mlen - 1];
+  const char *lp; /* next copy of c */
+  const char *up; /* next copy of uc */
+  char uc;        /* other case of c */
+  int i;
+
+  if (stop - start < g->mlen)
+    {
+      return NULL;
+    }
+
+  last = stop - g->mlen;
+  if (g->fold != NULL)
+    {
+      /* one memchr(3) for each case of the first character */
+      uc = (char)toupper((uch)c);
+      lp = memchr(start, c, (size_t)( last - start + 1 ));
+      up = ( uc == c ) ? NULL : memchr(start, uc, (size_t)( last - start + 1 ));
+      while (lp != NULL || up != NULL)
+        {
+          dp = ( up == NULL || ( lp != NULL && lp < up )) ? lp : up;
+          if (FOLD(g, dp[g->mlen - 1]) == lc)
+            {
+              for (i = 1; i < g->mlen - 1; i++)
+                {
+                  if (FOLD(g, dp[i]) != g->must[i])
+                    {
+                      break;
+                    }
+                }
+
+              if (i >= g->mlen - 1)
+                {
+                  return dp;
+                }
+            }
+
+          if (dp == lp)
+            {
+              lp = memchr(dp + 1, c, (size_t)( last - dp ));
+            }
+          else
+            {
+              up = memchr(dp + 1, uc, (size_t)( last - dp ));
+            }
+        }
+
+      return NULL;
+    }
+
+  for (dp = start; dp <= last; dp++)
+    {
+      dp = memchr(dp, c, (size_t)( last - dp + 1 ));
+      if (dp == NULL)
+        {
+          break;
+        }
+
+      if (dp[g->mlen - 1] == lc && memcmp(dp, g->must, g->mlen) == 0)
+        {
+          return dp;
+        }
+    }
+
+  return NULL;
+}
+
 /*
  * - fast - step through the string at top speed
  */
@@ -926,6 +1150,14 @@ fast(struct match *m, const char *start, const char *stop, sopno startst,
   int flagch;
   int i;
   const char *coldp; /* last p after which no match was underway */
+  const char *dp;
+  struct dfa *d;
+
+  if (startst == m->g->firststate + 1 && stopst == m->g->laststate
+      && ( d = dfaget(m)) != NULL && dfafast(m, d, start, stop, &dp) == 0)
+    {
+      return dp;
+    }
 
   if (start == m->offp || ( start == m->beginp && !( m->eflags & REG_NOTBOL )))
     {
@@ -946,12 +1178,24 @@ fast(struct match *m, const char *start, const char *stop, sopno startst,
     {
       /* next character */
       lastc = c;
-      c = ( p == m->endp ) ? OUT : *p;
       if (EQ(st, fresh))
         {
+          /*
+           * Nothing is underway; if every match starts with
+           * g->must, skip to the next place one could start.
+           */
+          if (m->g->mstart && p < stop
+              && ( dp = mustfind(m->g, p, stop) ) != p)
+            {
+              p = ( dp == NULL ) ? stop : dp;
+              lastc = *( p - 1 );
+            }
+
           coldp = p;
         }
 
+      c = ( p == m->endp ) ? OUT : *p;
+
       /* is there an EOL and/or BOL between lastc and c? */
       flagch = '\0';
       i = 0;
@@ -1042,6 +1286,13 @@ slow(struct match *m, const char *start, const char *stop, sopno startst,
   int flagch;
   int i;
   const char *matchp; /* last p at which a match ended */
+  struct dfa *d;
+
+  if (startst == m->g->firststate + 1 && stopst == m->g->laststate
+      && ( d = dfaget(m)) != NULL && dfaslow(m, d, start, stop, &matchp) == 0)
+    {
+      return matchp;
+    }
 
   if (start == m->offp || ( start == m->beginp && !( m->eflags & REG_NOTBOL )))
     {
@@ -1134,6 +1385,512 @@ slow(struct match *m, const char *start, const char *stop, sopno startst,
   return matchp;
 }
 
+/*
+ * - dfaget - get the calling thread's DFA for the RE, or NULL to use the NFA
+ */
+static struct dfa *
+dfaget(struct match *m)
+{
+  struct re_guts *g = m->g;
+  const sopno gf = g->firststate + 1;
+  const sopno gl = g->laststate;
+  struct dfa *d;
+  states st = m->st;
+
+  (void)pthread_once(&dfaonce, dfakeyinit);
+  if (!dfakeyok)
+    {
+      return NULL;
+    }
+
+  d = pthread_getspecific(dfakey);
+  if (d != NULL && ( d->g != g || d->id != g->id ))
+    {
+      dfafree(d);
+      d = NULL;
+      (void)pthread_setspecific(dfakey, NULL);
+    }
+
+  if (d == NULL)
+    {
+      if (( d = calloc(1, sizeof ( struct dfa ))) == NULL)
+        {
+          return NULL;
+        }
+
+      d->g = g;
+      d->id = g->id;
+      if (pthread_setspecific(dfakey, d) != 0)
+        {
+          free(d);
+          return NULL;
+        }
+    }
+
+  if (d->flushes >= DFA_FLUSHES)
+    {
+      return NULL;
+    }
+
+  if (d->start == NULL)
+    {
+      CLEAR(st);
+      SET1(st, gf);
+      st = step(g, gf, gl, st, NOTHING, st);
+      if (( d->start = dfaintern(m, d, st)) == NULL)
+        {
+          return NULL;
+        }
+    }
+
+  return d;
+}
+
+/*
+ * - dfafast - fast(), using the DFA
+ *
+ * Returns 1 if the DFA outgrew its space, and the NFA has to do it.
+ */
+static int
+dfafast(struct match *m, struct dfa *d, const char *start, const char *stop,
+        const char **endp)
+{
+  struct dfastate *ds = d->start;
+  struct dfastate *ns;
+  const char *p = start;
+  int c;
+  int lastc; /* previous c */
+  int flagch;
+  int i;
+  const char *coldp; /* last p after which no match was underway */
+  const char *dp;
+
+  if (start == m->offp || ( start == m->beginp && !( m->eflags & REG_NOTBOL )))
+    {
+      c = OUT;
+    }
+  else
+    {
+      c = *( start - 1 );
+    }
+
+  coldp = NULL;
+  for (;;)
+    {
+      /* next character */
+      lastc = c;
+      if (ds->fresh)
+        {
+          /* see fast() */
+          if (m->g->mstart && p < stop
+              && ( dp = mustfind(m->g, p, stop) ) != p)
+            {
+              p = ( dp == NULL ) ? stop : dp;
+              lastc = *( p - 1 );
+            }
+
+          coldp = p;
+        }
+
+      c = ( p == m->endp ) ? OUT : *p;
+
+      /* is there an EOL and/or BOL between lastc and c? */
+      flagch = '\0';
+      i = 0;
+      if (( lastc == '\n' && m->g->cflags & REG_NEWLINE )
+          || ( lastc == OUT && !( m->eflags & REG_NOTBOL )))
+        {
+          flagch = BOL;
+          i = m->g->nbol;
+        }
+
+      if (( c == '\n' && m->g->cflags & REG_NEWLINE )
+          || ( c == OUT && !( m->eflags & REG_NOTEOL )))
+        {
+          flagch = ( flagch == BOL ) ? BOLEOL : EOL;
+          i += m->g->neol;
+        }
+
+      if (i != 0)
+        {
+          if (( ns = ds->flag[flagch - OUT] ) == NULL
+              && ( ns = dfastep(m, d, ds, DFA_FLAG, flagch) ) == NULL)
+            {
+              return 1;
+            }
+
+          ds = ns;
+        }
+
+      /* how about a word boundary? */
+      if (( flagch == BOL || ( lastc != OUT && !ISWORD(lastc)))
+          && ( c != OUT && ISWORD(c)))
+        {
+          flagch = BOW;
+        }
+
+      if (( lastc != OUT && ISWORD(lastc))
+          && ( flagch == EOL || ( c != OUT && !ISWORD(c))))
+        {
+          flagch = EOW;
+        }
+
+      if (flagch == BOW || flagch == EOW)
+        {
+          if (( ns = ds->flag[flagch - OUT] ) == NULL
+              && ( ns = dfastep(m, d, ds, DFA_FLAG, flagch) ) == NULL)
+            {
+              return 1;
+            }
+
+          ds = ns;
+        }
+
+      /* are we done? */
+      if (ds->stop || p == stop)
+        {
+          break; /* NOTE BREAK OUT */
+        }
+
+      /* no, we must deal with this character */
+      assert(c != OUT);
+      if (( ns = ds->fnext[(uch)c] ) == NULL
+          && ( ns = dfastep(m, d, ds, DFA_FAST, c) ) == NULL)
+        {
+          return 1;
+        }
+
+      ds = ns;
+      p++;
+    }
+
+  assert(coldp != NULL);
+  m->coldp = coldp;
+  *endp = ds->stop ? p + 1 : NULL;
+  return 0;
+}
+
+/*
+ * - dfaslow - slow(), using the DFA
+ *
+ * Returns 1 if the DFA outgrew its space, and the NFA has to do it.
+ */
+static int
+dfaslow(struct match *m, struct dfa *d, const char *start, const char *stop,
+        const char **endp)
+{
+  struct dfastate *ds = d->start;
+  struct dfastate *ns;
+  const char *p = start;
+  int c;
+  int lastc; /* previous c */
+  int flagch;
+  int i;
+  const char *matchp; /* last p at which a match ended */
+
+  if (start == m->offp || ( start == m->beginp && !( m->eflags & REG_NOTBOL )))
+    {
+      c = OUT;
+    }
+  else
+    {
+      c = *( start - 1 );
+    }
+
+  matchp = NULL;
+  for (;;)
+    {
+      /* next character */
+      lastc = c;
+      c = ( p == m->endp ) ? OUT : *p;
+
+      /* is there an EOL and/or BOL between lastc and c? */
+      flagch = '\0';
+      i = 0;
+      if (( lastc == '\n' && m->g->cflags & REG_NEWLINE )
+          || ( lastc == OUT && !( m->eflags & REG_NOTBOL )))
+        {
+          flagch = BOL;
+          i = m->g->nbol;
+        }
+
+      if (( c == '\n' && m->g->cflags & REG_NEWLINE )
+          || ( c == OUT && !( m->eflags & REG_NOTEOL )))
+        {
+          flagch = ( flagch == BOL ) ? BOLEOL : EOL;
+          i += m->g->neol;
+        }
+
+      if (i != 0)
+        {
+          if (( ns = ds->flag[flagch - OUT] ) == NULL
+              && ( ns = dfastep(m, d, ds, DFA_FLAG, flagch) ) == NULL)
+            {
+              return 1;
+            }
+
+          ds = ns;
+        }
+
+      /* how about a word boundary? */
+      if (( flagch == BOL || ( lastc != OUT && !ISWORD(lastc)))
+          && ( c != OUT && ISWORD(c)))
+        {
+          flagch = BOW;
+        }
+
+      if (( lastc != OUT && ISWORD(lastc))
+          && ( flagch == EOL || ( c != OUT && !ISWORD(c))))
+        {
+          flagch = EOW;
+        }
+
+      if (flagch == BOW || flagch == EOW)
+        {
+          if (( ns = ds->flag[flagch - OUT] ) == NULL
+              && ( ns = dfastep(m, d, ds, DFA_FLAG, flagch) ) == NULL)
+            {
+              return 1;
+            }
+
+          ds = ns;
+        }
+
+      /* are we done? */
+      if (ds->stop)
+        {
+          matchp = p;
+        }
+
+      if (ds->empty || p == stop)
+        {
+          break; /* NOTE BREAK OUT */
+        }
+
+      /* no, we must deal with this character */
+      assert(c != OUT);
+      if (( ns = ds->snext[(uch)c] ) == NULL
+          && ( ns = dfastep(m, d, ds, DFA_SLOW, c) ) == NULL)
+        {
+          return 1;
+        }
+
+      ds = ns;
+      p++;
+    }
+
+  *endp = matchp;
+  return 0;
+}
+
+/*
+ * - dfastep - fill in a DFA transition, using the NFA
+ */
+static struct dfastate * /* the new state, or NULL if out of space */
+dfastep(struct match *m, struct dfa *d, struct dfastate *ds, int kind, int c)
+{
+  struct re_guts *g = m->g;
+  const sopno gf = g->firststate + 1;
+  const sopno gl = g->laststate;
+  states st = m->st;
+  states tmp = m->tmp;
+  struct dfastate *ns;
+  int i;
+
+  switch (kind)
+    {
+    case DFA_FAST:
+      ASSIGN(tmp, ds->set);
+      ASSIGN(st, d->start->set);
+      st = step(g, gf, gl, tmp, c, st);
+      break;
+
+    case DFA_SLOW:
+      ASSIGN(tmp, ds->set);
+      CLEAR(st);
+      st = step(g, gf, gl, tmp, c, st);
+      break;
+
+    default:
+      /* as many steps as fast() and slow() would take */
+      if (c == BOL)
+        {
+          i = g->nbol;
+        }
+      else if (c == EOL)
+        {
+          i = g->neol;
+        }
+      else if (c == BOLEOL)
+        {
+          i = g->nbol + g->neol;
+        }
+      else
+        {
+          i = 1;
+        }
+
+      ASSIGN(st, ds->set);
+      for (; i > 0; i--)
+        {
+          st = step(g, gf, gl, st, c, st);
+        }
+
+      break;
+    }
+
+  /* if the DFA was thrown away, ds is gone */
+  if (( ns = dfaintern(m, d, st)) == NULL)
+    {
+      return NULL;
+    }
+
+  switch (kind)
+    {
+    case DFA_FAST:
+      ds->fnext[(uch)c] = ns;
+      break;
+
+    case DFA_SLOW:
+      ds->snext[(uch)c] = ns;
+      break;
+
+    default:
+      ds->flag[c - OUT] = ns;
+      break;
+    }
+
+  return ns;
+}
+
+/*
+ * - dfaintern - find or add the DFA state for a state set
+ */
+static struct dfastate * /* the state, or NULL if out of space */
+dfaintern(struct match *m, struct dfa *d, states st)
+{
+  struct dfastate *ds;
+  const uch *cp = (const uch *)SETBYTES(st);
+  const size_t size = sizeof ( struct dfastate ) + SETSPACE(m);
+  size_t i;
+  unsigned int h;
+
+  for (h = 2166136261U, i = 0; i < (size_t)SETSIZE(m); i++)
+    {
+      h = ( h ^ cp[i] ) * 16777619U;
+    }
+
+  for (ds = d->hash[h % DFA_HASH]; ds != NULL; ds = ds->hnext)
+    {
+      if (ds->hash == h && EQ(ds->set, st))
+        {
+          return ds;
+        }
+    }
+
+  if (d->mem + size > DFA_MAXMEM)
+    {
+      dfaflush(d);
+      d->flushes++;
+      return NULL;
+    }
+
+  if (( ds = calloc(1, size)) == NULL)
+    {
+      return NULL;
+    }
+
+  SETHOME(ds->set, (char *)( ds + 1 ));
+  ASSIGN(ds->set, st);
+  ds->hash = h;
+  ds->fresh = ( d->start == NULL || EQ(st, d->start->set));
+  ds->empty = EQ(st, m->empty);
+  ds->stop = ISSET(st, m->g->laststate) != 0;
+  ds->hnext = d->hash[h % DFA_HASH];
+  d->hash[h % DFA_HASH] = ds;
+  d->mem += size;
+  return ds;
+}
+
+/*
+ * - dfaflush - throw away a DFA's states
+ */
+static void
+dfaflush(struct dfa *d)
+{
+  struct dfastate *ds;
+  struct dfastate *next;
+  int i;
+
+  for (i = 0; i < DFA_HASH; i++)
+    {
+      for (ds = d->hash[i]; ds != NULL; ds = next)
+        {
+          next = ds->hnext;
+          free(ds);
+        }
+
+      d->hash[i] = NULL;
+    }
+
+  d->start = NULL;
+  d->mem = 0;
+}
+
+/*
+ * - dfafree - free a DFA, also called when a thread exits
+ */
+static void
+dfafree(void *arg)
+{
+  struct dfa *d = arg;
+
+  dfaflush(d);
+  free(d);
+}
+
+/*
+ * - dfakeyinit - create the key for the per-thread DFA
+ */
+static void
+dfakeyinit(void)
+{
+  dfakeyok = ( pthread_key_create(&dfakey, dfafree) == 0 );
+}
+
+/*
+ * - backstack - how much stack backref() may use
+ *
+ * The matcher runs on the main thread, whose stack is limited by
+ * RLIMIT_STACK, or on a worker thread, which common/thread.c gives at
+ * least MAX_BACKSTACK.  Use the smaller of the two, less some slack for
+ * the callers and the signal handlers.
+ */
+static size_t
+backstack(void)
+{
+  (void)pthread_once(&backonce, backinit);
+  return backbytes;
+}
+
+/*
+ * - backinit - find out how much stack backref() may use
+ */
+static void
+backinit(void)
+{
+  struct rlimit rl;
+  size_t bytes = MAX_BACKSTACK;
+
+  if (getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+      && rl.rlim_cur < bytes)
+    {
+      bytes = rl.rlim_cur;
+    }
+
+  backbytes = bytes > 2 * BACKSTACK_SLACK ? bytes - BACKSTACK_SLACK : bytes / 2;
+}
+
 /*
  * - step - map set of states reachable before char to set reachable after
  */
@@ -1151,6 +1908,11 @@ step(struct re_guts *g, sopno start,  /* start state within strip */
   sopno look;
   int i;
 
+  if (!NONCHAR(ch))
+    {
+      ch = FOLD(g, ch);
+    }
+
   for (pc = start, INIT(here, pc); pc != stop; pc++, INC(here))
     {
       s = g->strip[pc];
@@ -1396,8 +2158,27 @@ pchar(int ch)
 #undef slow
 #undef dissect
 #undef backref
+#undef backtrack
 #undef step
 #undef print
 #undef at
 #undef match
 #undef nope
+#undef mustfind
+#undef dfa
+#undef dfastate
+#undef dfaget
+#undef dfafast
+#undef dfaslow
+#undef dfastep
+#undef dfaintern
+#undef dfaflush
+#undef dfafree
+#undef dfakeyinit
+#undef dfakey
+#undef dfaonce
+#undef dfakeyok
+#undef backstack
+#undef backinit
+#undef backonce
+#undef backbytes
@@ -0,0 +1,608 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Copyright (c) 2022-2023 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * See the LICENSE.md file for redistribution information.
+ */
+
+/*
+ * rebench - time the regex engine over a corpus of patterns and texts
+ *
+ * usage: rebench [-c] [-t seconds] [file ...]
+ *
+ * Each pattern in the table below is compiled, then run over each text a
+ * line at a time with REG_STARTEND, the way the editor searches, for at
+ * least the given time (default 0.2 seconds).  For each pattern it reports
+ * the path regexec() takes, the number of NFA states, the length of the
+ * must string and the compile time; and for each text the throughput, the
+ * number of matching lines, and how many DFA states matching built.  The
+ * synthetic texts come out the same every run, so the output of two builds
+ * can be compared to catch regressions.  The files named on the command
+ * line, e.g. the editor's own sources, are the real world text.
+ *
+ * With -c, nothing is timed: instead regexec_last(), and for RE's without
+ * back references the single pass it can switch to, are checked against
+ * calling regexec() from every start, on lines of the texts longer than
+ * 20 characters (the first 256 of longer ones).  The exit status is 1 if
+ * any answer differs.
+ *
+ * regexec.c is included, rather than linked, to get at the DFA.
+ */
+
+#include "regexec.c"
+
+#include <time.h>
+
+#define TEXTSIZE ( 4 * 1024 * 1024 ) /* bytes of each synthetic text */
+#define LONGLINE ( 64 * 1024 )       /* length of the long lines */
+#define MAXTEXTS 8
+#define CHECKMIN 21                  /* shortest line -c checks */
+#define CHECKMAX 256                 /* most of a line -c checks */
+#define CHECKLINES 2000              /* most lines -c checks in a text */
+
+struct text
+{
+  const char *name;
+  char *buf;      /* the lines, end to end */
+  size_t *off;    /* line i runs from off[i] to off[i + 1] */
+  size_t nlines;
+  size_t size;
+};
+
+static const struct pattern
+{
+  const char *kind;
+  int cflags;
+  const char *re;
+} patterns[] = {
+  { "literal", 0, "error" },
+  { "literal", 0, "connection reset" },
+  { "literal", 0, "zqxj" },
+  { "class", 0, "[0-9][0-9]*" },
+  { "class", 0, "[[:upper:]][[:lower:]]*ing" },
+  { "class", 0, "[^ ]*@[^ ]*\\.[a-z][a-z]*" },
+  { "class", 0, "[0-9]\\{3,5\\} ms" },
+  { "altern", REG_EXTENDED, "error|warn|fatal" },
+  { "altern", REG_EXTENDED, "(GET|POST|PUT) /[a-z]+" },
+  { "altern", REG_EXTENDED, "(web0|web1)[0-9] app\\[[0-9]+\\]: (INFO|DEBUG)" },
+  { "backref", 0, "\\([a-z][a-z]*\\) \\1" },
+  { "backref", 0, "\\(.\\)\\1\\1" },
+  { "anchor", 0, "^2023-0[1-6]" },
+  { "anchor", 0, "ms$" },
+  { "anchor", 0, "^$" },
+  { "icase", REG_ICASE, "error" },
+  { "icase", REG_ICASE, "connection.*peer" },
+  { "word", 0, "\\<the\\>" },
+  { "word", 0, "\\<.*\\<a" },
+  { "word", 0, "[a-z]*\\>.*\\>" },
+  { "word", REG_EXTENDED, "\\<(.*\\<(a|the|[0-9]+)\\>){1,3}" },
+  { "dotstar", 0, "a.*b.*c" },
+  { "dotstar", 0, "request.*served in [0-9]* ms" },
+  { "large", 0, "[a-z]\\{40\\}" },
+  { "large", REG_EXTENDED, "(a|b|c|d|e|f|g|h|i|j|k|l|m|n|o|p|q|r|s|t)+xyz" },
+};
+
+static const char *const words[] = {
+  "the",  "editor", "reads",   "lines",   "from",     "file", "and",
+  "of",   "buffer", "Editing", "Writing", "searches", "text", "Mark",
+  "vi",   "ex",     "options", "cursor",  "screen",   "a",    "is",
+  "that", "with",   "Testing", "b",       "c",        "user", "abc",
+};
+
+static const char *const levels[] = {
+  "INFO", "DEBUG", "WARN", "error", "Error", "fatal",
+};
+
+static const char *const events[] = {
+  "request served in %lu ms",
+  "connection reset by peer",
+  "GET /index/%lu",
+  "POST /login from user%lu@example.com",
+  "cache miss for key user:%lu",
+  "retrying after %lu ms",
+};
+
+static unsigned long seed = 1;
+
+/*
+ * - rnd - a repeatable random number below n
+ */
+static unsigned long
+rnd(unsigned long n)
+{
+  seed = seed * 1103515245 + 12345;
+  return ( seed >> 8 ) % n;
+}
+
+/*
+ * - addline - add a line to a text
+ */
+static void
+addline(struct text *t, const char *line, size_t len)
+{
+  if (t->nlines % 1024 == 0)
+    {
+      t->off = reallocarray(t->off, t->nlines + 1025, sizeof ( size_t ));
+    }
+
+  t->buf = realloc(t->buf, t->size + len + 1);
+  if (t->buf == NULL || t->off == NULL)
+    {
+      (void)fprintf(stderr, "rebench: out of memory\n");
+      exit(1);
+    }
+
+  memcpy(t->buf + t->size, line, len);
+  t->off[t->nlines++] = t->size;
+  t->size += len;
+  t->off[t->nlines] = t->size;
+}
+
+/*
+ * - mklog - make a text of log file lines
+ */
+static void
+mklog(struct text *t)
+{
+  char line[256];
+  char ev[128];
+  int n;
+
+  t->name = "log";
+  while (t->size < TEXTSIZE)
+    {
+      (void)snprintf(ev, sizeof ( ev ), events[rnd(6)], rnd(100000));
+      n = snprintf(line, sizeof ( line ),
+                   "2023-%02lu-%02lu %02lu:%02lu:%02lu web%02lu app[%lu]: "
+                   "%s %lu %s",
+                   rnd(12) + 1, rnd(28) + 1, rnd(24), rnd(60), rnd(60),
+                   rnd(40), rnd(10000), levels[rnd(6)], rnd(1000), ev);
+      addline(t, line, (size_t)n);
+    }
+}
+
+/*
+ * - mkprose - make a text of words, with some blank lines
+ */
+static void
+mkprose(struct text *t)
+{
+  char line[1024];
+  size_t len;
+  const char *w;
+  unsigned long i;
+  unsigned long n;
+
+  t->name = "prose";
+  while (t->size < TEXTSIZE)
+    {
+      for (len = 0, i = 0, n = rnd(16); i < n; i++)
+        {
+          w = words[rnd(sizeof ( words ) / sizeof ( words[0] ))];
+          memcpy(line + len, w, strlen(w));
+          len += strlen(w);
+          line[len++] = ( rnd(8) == 0 ) ? '.' : ' ';
+        }
+
+      addline(t, line, len);
+    }
+}
+
+/*
+ * - mklong - make a text of long lines of mostly lower case letters
+ */
+static void
+mklong(struct text *t)
+{
+  char *line;
+  size_t i;
+
+  t->name = "long";
+  if (( line = malloc(LONGLINE)) == NULL)
+    {
+      (void)fprintf(stderr, "rebench: out of memory\n");
+      exit(1);
+    }
+
+  while (t->size < TEXTSIZE)
+    {
+      for (i = 0; i < LONGLINE; i++)
+        {
+          line[i] = ( rnd(10) == 0 ) ? ' ' : (char)( 'a' + rnd(26));
+        }
+
+      addline(t, line, LONGLINE);
+    }
+
+  free(line);
+}
+
+/*
+ * - mkfiles - make a text of the lines of some files
+ */
+static void
+mkfiles(struct text *t, char **files, int nfiles)
+{
+  FILE *fp;
+  char *line = NULL;
+  size_t blen = 0;
+  ssize_t len;
+  int i;
+
+  t->name = "files";
+  for (i = 0; i < nfiles; i++)
+    {
+      if (( fp = fopen(files[i], "r")) == NULL)
+        {
+          perror(files[i]);
+          continue;
+        }
+
+      while (( len = getline(&line, &blen, fp)) > 0)
+        {
+          if (line[len - 1] == '\n')
+            {
+              len--;
+            }
+
+          addline(t, line, (size_t)len);
+        }
+
+      (void)fclose(fp);
+    }
+
+  free(line);
+}
+
+/*
+ * - now - the time in seconds
+ */
+static double
+now(void)
+{
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * - path - the path regexec() takes for an RE, as it decides in regexec()
+ */
+static const char *
+path(struct re_guts *g)
+{
+  if (g->literal)
+    {
+      return "literal";
+    }
+
+  if (g->bitpar != NULL)
+    {
+      return "bitpar";
+    }
+
+  if (g->nstates <= CHAR_BIT * sizeof ( states1 ))
+    {
+      return g->backrefs ? "small+br" : "small";
+    }
+
+  return g->backrefs ? "large+br" : "large";
+}
+
+/*
+ * - dfasize - count the states in the calling thread's DFA for an RE
+ */
+static size_t
+dfasize(struct re_guts *g, int *flushes)
+{
+  struct sdfa *sd;
+  struct sdfastate *ss;
+  struct ldfa *ld;
+  struct ldfastate *ls;
+  size_t n = 0;
+  int i;
+
+  *flushes = 0;
+  if (g->nstates <= CHAR_BIT * sizeof ( states1 ))
+    {
+      if (!sdfakeyok || ( sd = pthread_getspecific(sdfakey)) == NULL
+          || sd->g != g || sd->id != g->id)
+        {
+          return 0;
+        }
+
+      for (i = 0; i < DFA_HASH; i++)
+        {
+          for (ss = sd->hash[i]; ss != NULL; ss = ss->hnext)
+            {
+              n++;
+            }
+        }
+
+      *flushes = sd->flushes;
+      return n;
+    }
+
+  if (!ldfakeyok || ( ld = pthread_getspecific(ldfakey)) == NULL
+      || ld->g != g || ld->id != g->id)
+    {
+      return 0;
+    }
+
+  for (i = 0; i < DFA_HASH; i++)
+    {
+      for (ls = ld->hash[i]; ls != NULL; ls = ls->hnext)
+        {
+          n++;
+        }
+    }
+
+  *flushes = ld->flushes;
+  return n;
+}
+
+/*
+ * - runtext - match an RE against every line of a text, n times
+ */
+static size_t
+runtext(regex_t *re, struct text *t, int n)
+{
+  regmatch_t m[1];
+  size_t hits = 0;
+  size_t i;
+
+  while (n-- > 0)
+    {
+      for (hits = 0, i = 0; i < t->nlines; i++)
+        {
+          m[0].rm_so = 0;
+          m[0].rm_eo = t->off[i + 1] - t->off[i];
+          if (regexec(re, t->buf + t->off[i], 1, m, REG_STARTEND) == 0)
+            {
+              hits++;
+            }
+        }
+    }
+
+  return hits;
+}
+
+/*
+ * - lastslow - regexec_last(), by trying every start before limit
+ */
+static regoff_t
+lastslow(regex_t *re, const char *line, size_t len, regoff_t limit)
+{
+  regmatch_t m[1];
+  regoff_t last = -1;
+  regoff_t so;
+
+  for (so = 0; so < limit; so++)
+    {
+      m[0].rm_so = so;
+      m[0].rm_eo = len;
+      if (regexec(re, line, 1, m, REG_STARTEND | ( so > 0 ? REG_NOTBOL : 0 ))
+              == 0
+          && m[0].rm_so == so)
+        {
+          last = so;
+        }
+    }
+
+  return last;
+}
+
+/*
+ * - checktext - check regexec_last() on the lines of a text, count misses
+ */
+static size_t
+checktext(regex_t *re, struct text *t, size_t *checked)
+{
+  struct re_guts *g = re->re_g;
+  regmatch_t m[1];
+  const char *line;
+  const char *last;
+  size_t bad = 0;
+  size_t len;
+  size_t i;
+  regoff_t limit;
+  regoff_t want;
+  regoff_t got;
+
+  *checked = 0;
+  for (i = 0; i < t->nlines && *checked < CHECKLINES; i++)
+    {
+      line = t->buf + t->off[i];
+      len = t->off[i + 1] - t->off[i];
+      if (len < CHECKMIN)
+        {
+          continue;
+        }
+
+      if (len > CHECKMAX)
+        {
+          len = CHECKMAX; /* long lines are checked at the start */
+        }
+
+      ++*checked;
+      limit = ( *checked % 2 ) ? (regoff_t)len : (regoff_t)rnd(len) + 1;
+      want = lastslow(re, line, len, limit);
+
+      m[0].rm_so = 0;
+      m[0].rm_eo = len;
+      got = regexec_last(re, line, 1, m, REG_STARTEND, limit) == 0
+                ? m[0].rm_so
+                : -1;
+
+      /* and the single pass alone, from the first match */
+      if (got == want && want >= 0 && !g->backrefs)
+        {
+          m[0].rm_so = 0;
+          m[0].rm_eo = len;
+          (void)regexec(re, line, 1, m, REG_STARTEND);
+          got = lastfind(g, line, line + m[0].rm_so, line + len,
+                         line + limit, m[0].rm_so > 0 ? REG_NOTBOL : 0,
+                         &last) == 0
+                    ? last - line
+                    : -1;
+        }
+
+      if (got != want)
+        {
+          if (bad++ == 0)
+            {
+              (void)printf("  line %lu, limit %ld: expected %ld, got %ld\n",
+                           (unsigned long)i + 1, (long)limit, (long)want,
+                           (long)got);
+            }
+        }
+    }
+
+  return bad;
+}
+
+/*
+ * - check - run checktext() for every pattern over every text
+ */
+static int
+check(struct text *texts, int ntexts)
+{
+  const struct pattern *pp;
+  regex_t re;
+  size_t checked;
+  size_t bad;
+  int rv = 0;
+  int i;
+
+  (void)printf("%-7s %-30s %-5s %8s %8s\n", "kind", "pattern", "text",
+               "lines", "wrong");
+  for (pp = patterns; pp < patterns + sizeof ( patterns ) / sizeof ( *pp );
+       pp++)
+    {
+      if (regcomp(&re, pp->re, pp->cflags) != 0)
+        {
+          continue;
+        }
+
+      for (i = 0; i < ntexts; i++)
+        {
+          bad = checktext(&re, &texts[i], &checked);
+          (void)printf("%-7s %-30.30s %-5s %8lu %8lu\n", i == 0 ? pp->kind : "",
+                       i == 0 ? pp->re : "", texts[i].name,
+                       (unsigned long)checked, (unsigned long)bad);
+          if (bad != 0)
+            {
+              rv = 1;
+            }
+        }
+
+      regfree(&re);
+    }
+
+  return rv;
+}
+
+int
+main(int argc, char *argv[])
+{
+  const struct pattern *pp;
+  struct text texts[MAXTEXTS];
+  struct re_guts *g;
+  regex_t re;
+  double mintime = 0.2;
+  double t0;
+  double el;
+  size_t hits;
+  size_t ndfa;
+  int flushes;
+  int ntexts;
+  int n;
+  int i;
+  int rv = 0;
+  int checking = 0;
+  char err[128];
+
+  if (argc > 1 && strcmp(argv[1], "-c") == 0)
+    {
+      checking = 1;
+      argc--;
+      argv++;
+    }
+
+  if (argc > 2 && strcmp(argv[1], "-t") == 0)
+    {
+      mintime = atof(argv[2]);
+      argc -= 2;
+      argv += 2;
+    }
+
+  memset(texts, 0, sizeof ( texts ));
+  mklog(&texts[0]);
+  mkprose(&texts[1]);
+  mklong(&texts[2]);
+  ntexts = 3;
+  if (argc > 1)
+    {
+      mkfiles(&texts[ntexts++], argv + 1, argc - 1);
+    }
+
+  if (checking)
+    {
+      return check(texts, ntexts);
+    }
+
+  (void)printf("%-7s %-30s %-8s %6s %4s %9s  %-5s %8s %8s %6s\n", "kind",
+               "pattern", "path", "states", "must", "comp(us)", "text",
+               "MB/s", "matches", "dfa");
+  for (pp = patterns; pp < patterns + sizeof ( patterns ) / sizeof ( *pp );
+       pp++)
+    {
+      /* compile time */
+      t0 = now();
+      for (n = 0; ( el = now() - t0 ) < mintime / 4; n++)
+        {
+          if (( rv = regcomp(&re, pp->re, pp->cflags)) != 0)
+            {
+              (void)regerror(rv, &re, err, sizeof ( err ));
+              (void)printf("%-7s %-30.30s %s\n", pp->kind, pp->re, err);
+              break;
+            }
+
+          regfree(&re);
+        }
+
+      if (rv != 0)
+        {
+          continue;
+        }
+
+      (void)regcomp(&re, pp->re, pp->cflags);
+      g = re.re_g;
+      (void)printf("%-7s %-30.30s %-8s %6ld %4ld %9.2f", pp->kind, pp->re,
+                   path(g), (long)g->nstates, (long)g->mlen, el * 1e6 / n);
+
+      /* and matching, each text in turn */
+      for (i = 0; i < ntexts; i++)
+        {
+          t0 = now();
+          hits = runtext(&re, &texts[i], 1);
+          for (n = 1; ( el = now() - t0 ) < mintime; n *= 2)
+            {
+              (void)runtext(&re, &texts[i], n);
+            }
+
+          /* that's n runs in all */
+          ndfa = dfasize(g, &flushes);
+          (void)printf("%*s  %-5s %8.1f %8lu %5lu%s\n", i == 0 ? 0 : 69, "",
+                       texts[i].name, texts[i].size * (double)n / el
+                       / ( 1024 * 1024 ), (unsigned long)hits,
+                       (unsigned long)ndfa, flushes ? "+" : "");
+        }
+
+      regfree(&re);
+    }
+
+  return 0;
+}
@@ -111,6 +111,8 @@ static int enlarge(struct parse *, sopno);
 static void stripsnug(struct parse *, struct re_guts *);
 static void findmust(struct parse *, struct re_guts *);
 static sopno pluscount(struct parse *, struct re_guts *);
+static void findbitpar(struct parse *, struct re_guts *);
+static void foldinit(struct re_guts *);
 
 static char nuls[10]; /* place to point scanner in event of error */
 
@@ -160,6 +162,7 @@ static int never = 0; /* for use in asserts; shuts lint up */
 int /* 0 success, otherwise REG_something */
 regcomp(regex_t *preg, const char *pattern, int cflags)
 {
+  static unsigned long ids; /* last id handed out */
   struct parse pa;
   struct re_guts *g;
   struct parse *p = &pa;
@@ -230,8 +233,17 @@ regcomp(regex_t *preg, const char *pattern, int cflags)
   g->neol = 0;
   g->must = NULL;
   g->mlen = 0;
+  g->mstart = 0;
+  g->literal = 0;
+  g->id = ++ids;
+  g->bitpar = NULL;
+  g->fold = NULL;
   g->nsub = 0;
   g->backrefs = 0;
+  if (cflags & REG_ICASE)
+    {
+      foldinit(g);
+    }
 
   /* do it */
   EMIT(OEND, 0);
@@ -256,6 +268,7 @@ regcomp(regex_t *preg, const char *pattern, int cflags)
   stripsnug(p, g);
   findmust(p, g);
   g->nplus = pluscount(p, g);
+  findbitpar(p, g);
   g->magic = MAGIC2;
   preg->re_nsub = g->nsub;
   preg->re_g = g;
@@ -1128,6 +1141,42 @@ bothcases(struct parse *p, int ch)
   p->end = oldend;
 }
 
+/*
+ * - foldinit - set up the table the engine folds REG_ICASE input with
+ *
+ * Folding the input lets an ordinary character be one OCHAR, rather than
+ * a [] from bothcases(), so it can still be part of g->must and costs no
+ * more to match than it would without REG_ICASE.  []'s have both cases
+ * added anyway, so they match folded input as is.  If the locale's cases
+ * don't pair up, there's no table, and bothcases() does it the old way.
+ */
+static void
+foldinit(struct re_guts *g)
+{
+  int c;
+
+  if (( g->fold = malloc(NC)) == NULL)
+    {
+      return;
+    }
+
+  for (c = 0; c < NC; c++)
+    {
+      g->fold[c] = isupper(c) ? (uch)tolower(c) : (uch)c;
+    }
+
+  for (c = 0; c < NC; c++)
+    {
+      if (( isalpha(c) && g->fold[(uch)othercase(c)] != g->fold[c] )
+          || ( g->fold[c] != c && toupper(g->fold[c]) != c ))
+        {
+          free(g->fold);
+          g->fold = NULL;
+          return;
+        }
+    }
+}
+
 /*
  * - ordinary - emit an ordinary character
  */
@@ -1136,7 +1185,14 @@ ordinary(struct parse *p, int ch)
 {
   if (( p->g->cflags & REG_ICASE ) && isalpha((uch)ch) && othercase(ch) != ch)
     {
-      bothcases(p, ch);
+      if (p->g->fold != NULL)
+        {
+          EMIT(OCHAR, p->g->fold[(uch)ch]);
+        }
+      else
+        {
+          bothcases(p, ch);
+        }
     }
   else
     {
@@ -1726,6 +1782,17 @@ findmust(struct parse *p, struct re_guts *g)
 
   assert(cp == g->must + g->mlen);
   *cp = '\0'; /* just on general principles */
+
+  /* if only open parens come before it, every match starts with it */
+  for (scan = g->strip + 1; OP(*scan) == OLPAREN; scan++)
+    {
+      continue;
+    }
+
+  g->mstart = ( scan == start );
+
+  /* if it's nothing else, a match is just the first copy of it */
+  g->literal = ( g->mstart && g->nsub == 0 && g->mlen == g->nstates - 2 );
 }
 
 /*
@@ -1772,3 +1839,155 @@ pluscount(struct parse *p, struct re_guts *g)
 
   return maxnest;
 }
+
+/*
+ * - findbitpar - fill in the bit-parallel form, if the RE has one
+ *
+ * The strip is taken apart as items, each one of:
+ *
+ *      x                                       x
+ *      OPLUS_ x O_PLUS                         x+
+ *      OQUEST_ OPLUS_ x O_PLUS O_QUEST         x*
+ *      OQUEST_ x O_QUEST                       x? (from a BRE bound)
+ *      OCH_ x OOR1 OOR2 O_CH                   x?
+ *
+ * where x is an OCHAR, OANY or OANYOF.  Anything else (anchors, parens,
+ * back references, alternation) means there's no bit-parallel form.
+ */
+static void
+findbitpar(struct parse *p, struct re_guts *g)
+{
+  struct bitpar bp;
+  sop *scan;
+  sop s;
+  cset *cs;
+  unsigned long bit;
+  int loop;
+  int skip;
+  int run;
+  int c;
+
+  /* avoid making error situations worse */
+  if (p->error != 0)
+    {
+      return;
+    }
+
+  memset(&bp, 0, sizeof ( bp ));
+  bit = 1;
+  run = 0;
+  for (scan = g->strip + 1; OP(*scan) != OEND; scan++)
+    {
+      if (bit == 1UL << ( CHAR_BIT * sizeof ( bit ) - 1 ))
+        {
+          return; /* too many items */
+        }
+
+      loop = skip = 0;
+      if (OP(scan[0]) == OQUEST_ && OP(scan[1]) == OPLUS_
+          && OP(scan[3]) == O_PLUS && OP(scan[4]) == O_QUEST)
+        {
+          loop = skip = 1;
+          s = scan[2];
+          scan += 4;
+        }
+      else if (OP(scan[0]) == OQUEST_ && OP(scan[2]) == O_QUEST)
+        {
+          skip = 1;
+          s = scan[1];
+          scan += 2;
+        }
+      else if (OP(scan[0]) == OCH_ && OP(scan[2]) == OOR1
+               && OP(scan[3]) == OOR2 && OP(scan[4]) == O_CH)
+        {
+          skip = 1;
+          s = scan[1];
+          scan += 4;
+        }
+      else if (OP(scan[0]) == OPLUS_ && OP(scan[2]) == O_PLUS)
+        {
+          loop = 1;
+          s = scan[1];
+          scan += 2;
+        }
+      else
+        {
+          s = scan[0];
+        }
+
+      switch (OP(s))
+        {
+        case OCHAR:
+          bp.chars[(uch)OPND(s)] |= bit;
+          break;
+
+        case OANY:
+          for (c = 0; c < NC; c++)
+            {
+              bp.chars[c] |= bit;
+            }
+
+          break;
+
+        case OANYOF:
+          cs = &g->sets[OPND(s)];
+          for (c = 0; c < NC; c++)
+            {
+              if (CHIN(cs, (char)c))
+                {
+                  bp.chars[c] |= bit;
+                }
+            }
+
+          break;
+
+        default:
+          return; /* not an item */
+        }
+
+      if (loop)
+        {
+          bp.loop |= bit;
+        }
+
+      if (skip)
+        {
+          bp.skip |= bit;
+          if (++run > bp.nskip)
+            {
+              bp.nskip = run;
+            }
+        }
+      else
+        {
+          run = 0;
+        }
+
+      bit <<= 1;
+    }
+
+  bp.last = bit;
+  if (g->fold != NULL)
+    { /* the engine folds the input, this table doesn't */
+      for (c = 0; c < NC; c++)
+        {
+          bp.chars[c] |= bp.chars[g->fold[c]];
+        }
+    }
+
+  for (bp.init = 1, c = 0; c < bp.nskip; c++)
+    {
+      bp.init |= ( bp.init & bp.skip ) << 1;
+    }
+
+  if (bp.init & bp.last)
+    {
+      return; /* matches the empty string */
+    }
+
+  /* argh; just forget it */
+  if (( g->bitpar = malloc(sizeof ( bp ))) != NULL)
+    {
+      *g->bitpar = bp;
+    }
+}
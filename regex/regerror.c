@@ -78,6 +78,7 @@ static const struct rerr
       { REG_EMPTY,    "REG_EMPTY",    "empty (sub)expression"               },
       { REG_ASSERT,   "REG_ASSERT",   "\"can't happen\" -- you found a bug" },
       { REG_INVARG,   "REG_INVARG",   "invalid argument to regex routine"   },
+      { REG_ECOMPLEX, "REG_ECOMPLEX", "back references too complex"         },
       { 0,            "",             "*** unknown regexp error code ***"   } };
 
 /*
@@ -52,6 +52,9 @@
  */
 
 #include <sys/types.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <bsd_stdlib.h>
 #include <bsd_string.h>
@@ -84,6 +87,11 @@
 #define FWD(dst, src, n) (( dst ) |= ((unsigned long)( src ) & ( here )) << ( n ))
 #define BACK(dst, src, n) (( dst ) |= ((unsigned long)( src ) & ( here )) >> ( n ))
 #define ISSETBACK(v, n) ((( v ) & ((unsigned long)here >> ( n ))) != 0 )
+/* state sets as bytes, for the DFA; the set lives in the DFA state */
+#define SETBYTES(v) ((char *)&( v ))
+#define SETSIZE(m) sizeof ( long )
+#define SETSPACE(m) 0
+#define SETHOME(v, p) /* nothing */
 /* function names */
 #define SNAMES /* engine.c looks after details */
 
@@ -108,6 +116,10 @@
 #undef FWD
 #undef BACK
 #undef ISSETBACK
+#undef SETBYTES
+#undef SETSIZE
+#undef SETSPACE
+#undef SETHOME
 #undef SNAMES
 
 /* macros for manipulating states, large version */
@@ -147,11 +159,201 @@
 #define FWD(dst, src, n) (( dst )[here + ( n )] |= ( src )[here] )
 #define BACK(dst, src, n) (( dst )[here - ( n )] |= ( src )[here] )
 #define ISSETBACK(v, n) (( v )[here - ( n )] )
+/* state sets as bytes, for the DFA; the set follows the DFA state */
+#define SETBYTES(v) ( v )
+#define SETSIZE(m) (( m )->g->nstates )
+#define SETSPACE(m) (( m )->g->nstates )
+#define SETHOME(v, p) (( v ) = ( p ))
 /* function names */
 #define LNAMES /* flag */
 
 #include "engine.c"
 
+/*
+ * - bpstep - step the bit-parallel form over one character
+ */
+static inline unsigned long
+bpstep(const struct bitpar *bp, unsigned long st, int c)
+{
+  int i;
+
+  st &= bp->chars[(uch)c];
+  st = ( st << 1 ) | ( st & bp->loop );
+  for (i = 0; i < bp->nskip; i++)
+    {
+      st |= ( st & bp->skip ) << 1;
+    }
+
+  return st;
+}
+
+/*
+ * - bpmatcher - the matching engine for RE's with a bit-parallel form
+ *
+ * Same plan as matcher(): find where the earliest match ends, and the
+ * last point before it where no match was underway, then try starts from
+ * there on for the leftmost-longest match.  No subexpressions to dissect.
+ */
+static int /* 0 success, REG_NOMATCH failure */
+bpmatcher(struct re_guts *g, const char *string, size_t nmatch,
+          regmatch_t pmatch[], int eflags)
+{
+  const struct bitpar *bp = g->bitpar;
+  const char *start;
+  const char *stop;
+  const char *p;
+  const char *coldp; /* last p after which no match was underway */
+  const char *endp;
+  unsigned long st;
+  size_t i;
+
+  if (g->cflags & REG_NOSUB)
+    {
+      nmatch = 0;
+    }
+
+  if (eflags & REG_STARTEND)
+    {
+      start = string + pmatch[0].rm_so;
+      stop = string + pmatch[0].rm_eo;
+    }
+  else
+    {
+      start = string;
+      stop = start + strlen(start);
+    }
+
+  if (stop < start)
+    {
+      return REG_INVARG;
+    }
+
+  if (g->must != NULL && smustfind(g, start, stop) == NULL)
+    {
+      return REG_NOMATCH;
+    }
+
+  /* find the end of the earliest match; st is what's underway */
+  st = 0;
+  coldp = NULL;
+  for (p = start;; p++)
+    {
+      if (st == 0)
+        {
+          /* nothing underway, skip what can't start a match */
+          while (p < stop && !( bp->chars[(uch)*p] & bp->init ))
+            {
+              p++;
+            }
+
+          coldp = p;
+        }
+
+      if (p == stop)
+        {
+          return REG_NOMATCH;
+        }
+
+      st = bpstep(bp, st | bp->init, *p);
+      if (st & bp->last)
+        {
+          break;
+        }
+    }
+
+  if (nmatch == 0)
+    {
+      return 0;
+    }
+
+  /* find the leftmost start, and the longest match from it */
+  for (endp = NULL;; coldp++)
+    {
+      assert(coldp <= p);
+      for (st = bp->init, i = 0; st != 0 && coldp + i < stop; i++)
+        {
+          st = bpstep(bp, st, coldp[i]);
+          if (st & bp->last)
+            {
+              endp = coldp + i + 1;
+            }
+        }
+
+      if (endp != NULL)
+        {
+          break;
+        }
+    }
+
+  pmatch[0].rm_so = coldp - string;
+  pmatch[0].rm_eo = endp - string;
+  for (i = 1; i < nmatch; i++)
+    {
+      pmatch[i].rm_so = -1;
+      pmatch[i].rm_eo = -1;
+    }
+
+  return 0;
+}
+
+/*
+ * - litmatcher - the matching engine for RE's that are just a string
+ *
+ * The earliest copy of the string is the leftmost-longest match, and
+ * mustfind() finds it without running the RE.  That covers the plain
+ * words most searches are, in either case with REG_ICASE.
+ */
+static int /* 0 success, REG_NOMATCH failure */
+litmatcher(struct re_guts *g, const char *string, size_t nmatch,
+           regmatch_t pmatch[], int eflags)
+{
+  const char *start;
+  const char *stop;
+  const char *dp;
+  size_t i;
+
+  if (g->cflags & REG_NOSUB)
+    {
+      nmatch = 0;
+    }
+
+  if (eflags & REG_STARTEND)
+    {
+      start = string + pmatch[0].rm_so;
+      stop = string + pmatch[0].rm_eo;
+    }
+  else
+    {
+      start = string;
+      stop = start + strlen(start);
+    }
+
+  if (stop < start)
+    {
+      return REG_INVARG;
+    }
+
+  if (( dp = smustfind(g, start, stop)) == NULL)
+    {
+      return REG_NOMATCH;
+    }
+
+  if (nmatch == 0)
+    {
+      return 0;
+    }
+
+  pmatch[0].rm_so = dp - string;
+  pmatch[0].rm_eo = dp - string + g->mlen;
+  for (i = 1; i < nmatch; i++)
+    {
+      pmatch[i].rm_so = -1;
+      pmatch[i].rm_eo = -1;
+    }
+
+  return 0;
+}
+
 /*
  * - regexec - interface for matching
  *
@@ -184,7 +386,15 @@ regexec(const regex_t *preg, const char *string, size_t nmatch,
 
   eflags = GOODFLAGS(eflags);
 
-  if (g->nstates <= CHAR_BIT * sizeof ( states1 ) && !( eflags & REG_LARGE ))
+  if (g->literal && !( eflags & REG_LARGE ))
+    {
+      return litmatcher(g, string, nmatch, pmatch, eflags);
+    }
+  else if (g->bitpar != NULL && !( eflags & REG_LARGE ))
+    {
+      return bpmatcher(g, string, nmatch, pmatch, eflags);
+    }
+  else if (g->nstates <= CHAR_BIT * sizeof ( states1 ) && !( eflags & REG_LARGE ))
     {
       return smatcher(g, string, nmatch, pmatch, eflags);
     }
@@ -193,3 +403,564 @@ regexec(const regex_t *preg, const char *string, size_t nmatch,
       return lmatcher(g, string, nmatch, pmatch, eflags);
     }
 }
+
+/*
+ * Bookkeeping for regexec_last(): a set of states where each state
+ * remembers the latest place a match that's underway in it could have
+ * started, or NULL if the state isn't in the set.  Keeping the latest
+ * start when two ways into a state meet is enough, since what happens
+ * from there on doesn't depend on where the match started.
+ */
+#define LATER(d, s)                                                           \
+  {                                                                           \
+    if (( s ) != NULL && (( d ) == NULL || ( s ) > ( d )))                    \
+      ( d ) = ( s );                                                          \
+  }
+#define LFWD(dst, src, n) LATER(( dst )[pc + ( n )], ( src )[pc])
+
+/*
+ * - laststep - step(), for sets of states that know when they started
+ */
+static void
+laststep(struct re_guts *g, const char **bef, int ch, const char **aft)
+{
+  const sopno gf = g->firststate + 1;
+  const sopno gl = g->laststate;
+  const char *was;
+  cset *cs;
+  sop s;
+  sopno pc;
+  sopno look;
+
+  if (!NONCHAR(ch))
+    {
+      ch = FOLD(g, ch);
+    }
+
+  for (pc = gf; pc != gl; pc++)
+    {
+      s = g->strip[pc];
+      switch (OP(s))
+        {
+        case OEND:
+          break;
+
+        case OCHAR:
+          if (ch == (char)OPND(s))
+            {
+              LFWD(aft, bef, 1);
+            }
+
+          break;
+
+        case OBOL:
+          if (ch == BOL || ch == BOLEOL)
+            {
+              LFWD(aft, bef, 1);
+            }
+
+          break;
+
+        case OEOL:
+          if (ch == EOL || ch == BOLEOL)
+            {
+              LFWD(aft, bef, 1);
+            }
+
+          break;
+
+        case OBOW:
+          if (ch == BOW)
+            {
+              LFWD(aft, bef, 1);
+            }
+
+          break;
+
+        case OEOW:
+          if (ch == EOW)
+            {
+              LFWD(aft, bef, 1);
+            }
+
+          break;
+
+        case OANY:
+          if (!NONCHAR(ch))
+            {
+              LFWD(aft, bef, 1);
+            }
+
+          break;
+
+        case OANYOF:
+          cs = &g->sets[OPND(s)];
+          if (!NONCHAR(ch) && CHIN(cs, ch))
+            {
+              LFWD(aft, bef, 1);
+            }
+
+          break;
+
+        case O_PLUS: /* both forward and back */
+          LFWD(aft, aft, 1);
+          was = aft[pc - OPND(s)];
+          LFWD(aft, aft, -(sopno)OPND(s));
+          if (aft[pc - OPND(s)] != was)
+            {
+              /* a later start, the loop body has to pass it on */
+              pc -= OPND(s) + 1;
+            }
+
+          break;
+
+        case OQUEST_: /* two branches, both forward */
+          LFWD(aft, aft, 1);
+          LFWD(aft, aft, OPND(s));
+          break;
+
+        case OCH_: /* mark the first two branches */
+          LFWD(aft, aft, 1);
+          LFWD(aft, aft, OPND(s));
+          break;
+
+        case OOR1: /* done a branch, find the O_CH */
+          if (aft[pc] != NULL)
+            {
+              for (look = 1; OP(s = g->strip[pc + look]) != O_CH;
+                   look += OPND(s))
+                {
+                  continue;
+                }
+
+              LFWD(aft, aft, look + 1);
+            }
+
+          break;
+
+        case OOR2: /* propagate OCH_'s marking */
+          LFWD(aft, aft, 1);
+          if (OP(g->strip[pc + OPND(s)]) != O_CH)
+            {
+              LFWD(aft, aft, OPND(s));
+            }
+
+          break;
+
+        default: /* empties: OPLUS_, O_QUEST, O_CH, parens, back refs */
+          LFWD(aft, aft, 1);
+          break;
+        }
+    }
+}
+
+/*
+ * - lastflag - laststep() over a BOL, EOL, BOW or EOW, as regexec() would
+ *
+ * smatcher() steps from a copy of its states, so a step passes one
+ * assertion at most; lmatcher() steps its states in place, so it also
+ * passes assertions the step itself reached (as in "\<.*\<a" with an
+ * empty ".*").  Each has to be followed, or a start found here can be
+ * one regexec() doesn't match from.
+ */
+static void
+lastflag(struct re_guts *g, const char **st, int ch, const char **copy)
+{
+  if (g->nstates <= CHAR_BIT * sizeof ( states1 ))
+    {
+      memcpy(copy, st, g->nstates * sizeof ( *st ));
+      laststep(g, copy, ch, st);
+    }
+  else
+    {
+      laststep(g, st, ch, st);
+    }
+}
+
+/*
+ * - lastfind - where the last match starting before limit starts
+ *
+ * One pass over the string, the way fast() does it, but starting matches
+ * only before limit and remembering where they started.  Back references
+ * are treated as matching anything, so the answer is only right for RE's
+ * without them.
+ */
+static int /* 0 success, REG_NOMATCH failure */
+lastfind(struct re_guts *g, const char *string, const char *start,
+         const char *stop, const char *limit, int eflags, const char **lastp)
+{
+  const sopno gf = g->firststate + 1;
+  const sopno gl = g->laststate;
+  const char **space;
+  const char **st;
+  const char **tmp;
+  const char **swap;
+  const char **copy;
+  char *fresh;
+  const char *p;
+  const char *last;
+  int c;
+  int lastc;
+  int flagch;
+  int i;
+  int busy;
+  sopno j;
+
+  space = openbsd_reallocarray(NULL, 3 * g->nstates, sizeof ( *space ));
+  if (space == NULL)
+    {
+      return REG_ESPACE;
+    }
+
+  if (( fresh = calloc(g->nstates, 1)) == NULL)
+    {
+      free(space);
+      return REG_ESPACE;
+    }
+
+  /* the states a fresh start is in; start is before limit */
+  st = space;
+  tmp = space + g->nstates;
+  copy = space + 2 * g->nstates;
+  for (j = 0; j < g->nstates; j++)
+    {
+      st[j] = NULL;
+    }
+
+  st[gf] = start;
+  laststep(g, st, NOTHING, st);
+  for (j = 0; j < g->nstates; j++)
+    {
+      fresh[j] = st[j] != NULL;
+    }
+
+  if (start == string || !( eflags & REG_NOTBOL ))
+    {
+      c = OUT;
+    }
+  else
+    {
+      c = *( start - 1 );
+    }
+
+  last = NULL;
+  for (p = start;; p++)
+    {
+      lastc = c;
+      c = ( p == stop ) ? OUT : *p;
+
+      /* as fast() does it */
+      flagch = '\0';
+      i = 0;
+      if (( lastc == '\n' && g->cflags & REG_NEWLINE )
+          || ( lastc == OUT && !( eflags & REG_NOTBOL )))
+        {
+          flagch = BOL;
+          i = g->nbol;
+        }
+
+      if (( c == '\n' && g->cflags & REG_NEWLINE )
+          || ( c == OUT && !( eflags & REG_NOTEOL )))
+        {
+          flagch = ( flagch == BOL ) ? BOLEOL : EOL;
+          i += g->neol;
+        }
+
+      for (; i > 0; i--)
+        {
+          lastflag(g, st, flagch, copy);
+        }
+
+      if (( flagch == BOL || ( lastc != OUT && !ISWORD(lastc)))
+          && ( c != OUT && ISWORD(c)))
+        {
+          flagch = BOW;
+        }
+
+      if (( lastc != OUT && ISWORD(lastc))
+          && ( flagch == EOL || ( c != OUT && !ISWORD(c))))
+        {
+          flagch = EOW;
+        }
+
+      if (flagch == BOW || flagch == EOW)
+        {
+          lastflag(g, st, flagch, copy);
+        }
+
+      /* a match ends here, how late did it start? */
+      LATER(last, st[gl]);
+      if (p == stop)
+        {
+          break;
+        }
+
+      /* past the limit, done when nothing is underway */
+      if (p + 1 > limit)
+        {
+          for (busy = 0, j = 0; j < g->nstates; j++)
+            {
+              if (st[j] != NULL)
+                {
+                  busy = 1;
+                  break;
+                }
+            }
+
+          if (!busy)
+            {
+              break;
+            }
+        }
+
+      /* on to the next character, and a fresh start after it */
+      for (j = 0; j < g->nstates; j++)
+        {
+          tmp[j] = ( fresh[j] && p + 1 < limit ) ? p + 1 : NULL;
+        }
+
+      laststep(g, st, c, tmp);
+      swap = st;
+      st = tmp;
+      tmp = swap;
+    }
+
+  free(space);
+  free(fresh);
+  *lastp = last;
+  return last == NULL ? REG_NOMATCH : 0;
+}
+
+/*
+ * - regexec_last - find the match that starts last, before a limit
+ * = extern int regexec_last(const regex_t *, const char *, size_t,
+ * =                         regmatch_t [], int, regoff_t);
+ *
+ * Like regexec(), except that pmatch[0] gets the match that starts
+ * furthest along, of those starting before offset limit (they can end
+ * after it).  A match starts at an offset if regexec() from there, with
+ * REG_NOTBOL, finds one there.  Rather than trying every offset, this
+ * hops between matches, and RE's without back references switch to a
+ * single pass when that gets expensive.
+ */
+int /* 0 success, REG_NOMATCH failure */
+regexec_last(const regex_t *preg, const char *string, size_t nmatch,
+             regmatch_t pmatch[], int eflags, regoff_t limit)
+{
+  struct re_guts *g = preg->re_g;
+  regmatch_t m[1];
+  const char *start;
+  const char *stop;
+  const char *last;
+  regoff_t so;
+  regoff_t work;
+  int rv;
+
+  if (preg->re_magic != MAGIC1 || g->magic != MAGIC2)
+    {
+      return REG_BADPAT;
+    }
+
+  if (g->iflags & BAD)
+    {
+      return REG_BADPAT;
+    }
+
+  eflags = GOODFLAGS(eflags);
+  if (eflags & REG_STARTEND)
+    {
+      start = string + pmatch[0].rm_so;
+      stop = string + pmatch[0].rm_eo;
+    }
+  else
+    {
+      start = string;
+      stop = start + strlen(start);
+    }
+
+  if (stop < start)
+    {
+      return REG_INVARG;
+    }
+
+  /* the first match, which settles most of the misses cheaply */
+  m[0].rm_so = start - string;
+  m[0].rm_eo = stop - string;
+  rv = regexec(preg, string, 1, m, eflags | REG_STARTEND);
+  if (rv != 0)
+    {
+      return rv;
+    }
+
+  if (m[0].rm_so >= limit)
+    {
+      return REG_NOMATCH;
+    }
+
+  /*
+   * Hop from match to match, which is cheapest when they are short.
+   * Each hop scans on to the end of the next match, so long matches
+   * make this quadratic; once the hops have cost a few passes over
+   * the string, one pass from here finds the last start.
+   */
+  work = 0;
+  for (;;)
+    {
+      so = m[0].rm_so;
+      if (so + 1 >= stop - string || so + 1 >= limit)
+        {
+          break;
+        }
+
+      if (!g->backrefs && work > 4 * ( stop - start ))
+        {
+          rv = lastfind(g, string, string + so, stop, string + limit,
+                        eflags | ( so > start - string ? REG_NOTBOL : 0 ),
+                        &last);
+          if (rv != 0)
+            {
+              return rv;
+            }
+
+          so = last - string;
+          break;
+        }
+
+      m[0].rm_so = so + 1;
+      m[0].rm_eo = stop - string;
+      rv = regexec(preg, string, 1, m, eflags | REG_NOTBOL | REG_STARTEND);
+      if (rv == REG_NOMATCH)
+        {
+          break;
+        }
+
+      if (rv != 0)
+        {
+          return rv;
+        }
+
+      if (m[0].rm_so >= limit)
+        {
+          break;
+        }
+
+      work += m[0].rm_eo - so;
+    }
+
+  /* and the details of the match from there */
+  if (nmatch > 0 && !( g->cflags & REG_NOSUB ))
+    {
+      pmatch[0].rm_so = so;
+      pmatch[0].rm_eo = stop - string;
+      return regexec(preg, string, nmatch, pmatch,
+                     eflags | ( so > start - string ? REG_NOTBOL : 0 )
+                     | REG_STARTEND);
+    }
+
+  return 0;
+}
+
+/*
+ * - regexec_lines - find the first of a run of lines that matches
+ * = extern int regexec_lines(const regex_t *, const char *,
+ * =                          const size_t *, size_t, size_t *, int);
+ *
+ * The lines are stored end to end in buf, line i running from off[i] to
+ * off[i + 1], with no newlines between them.  Sets *linep to the first
+ * line regexec() doesn't return REG_NOMATCH for, and returns what it
+ * returned; if there's no such line, *linep is nlines and the return is
+ * REG_NOMATCH.
+ *
+ * Calling regexec() on each line costs a setup per line, most of it
+ * wasted when few lines match.  If the RE has a must string, the buffer
+ * is scanned for it a window of lines at a time, and only lines holding
+ * a copy get regexec().  A window ends on a line boundary, so a copy
+ * that fits in a line is never split between windows.  The windows
+ * start small, so finding a match in the first few lines stays cheap.
+ */
+#define LINESPAN 1024 /* most lines scanned for the must string at once */
+
+int /* 0 success, REG_NOMATCH failure */
+regexec_lines(const regex_t *preg, const char *buf, const size_t *off,
+              size_t nlines, size_t *linep, int eflags)
+{
+  struct re_guts *g = preg->re_g;
+  regmatch_t m[1];
+  const char *p;
+  int rv;
+  size_t i;
+  size_t e;
+  size_t lo;
+  size_t hi;
+  size_t span;
+
+  *linep = 0;
+  if (preg->re_magic != MAGIC1 || g->magic != MAGIC2 || g->iflags & BAD)
+    {
+      return REG_BADPAT;
+    }
+
+  eflags = GOODFLAGS(eflags) | REG_STARTEND;
+  for (i = 0, e = 0, span = 1; i < nlines; i++)
+    {
+      if (g->must != NULL)
+        {
+          /* the next window, twice as many lines as the last */
+          if (i >= e)
+            {
+              e = ( nlines - i > span ) ? i + span : nlines;
+              if (span < LINESPAN)
+                {
+                  span *= 2;
+                }
+            }
+
+          /* on to the line holding the next copy of the must string */
+          p = smustfind(g, buf + off[i], buf + off[e]);
+          if (p == NULL)
+            {
+              i = e - 1;
+              continue;
+            }
+
+          for (lo = i, hi = p < buf + off[i + 1] ? i + 1 : e; hi - lo > 1;)
+            {
+              if (buf + off[( lo + hi ) / 2] <= p)
+                {
+                  lo = ( lo + hi ) / 2;
+                }
+              else
+                {
+                  hi = ( lo + hi ) / 2;
+                }
+            }
+
+          if (p + g->mlen > buf + off[lo + 1])
+            {
+              /* it straddles two lines, look again from the second */
+              i = lo;
+              continue;
+            }
+
+          i = lo;
+
+          /* a copy that fits in the line is a match, if that's all it is */
+          if (g->literal)
+            {
+              *linep = i;
+              return 0;
+            }
+        }
+
+      m[0].rm_so = 0;
+      m[0].rm_eo = off[i + 1] - off[i];
+      if (( rv = regexec(preg, buf + off[i], 0, m, eflags) ) != REG_NOMATCH)
+        {
+          *linep = i;
+          return rv;
+        }
+    }
+
+  *linep = nlines;
+  return REG_NOMATCH;
+}
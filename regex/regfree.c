@@ -73,5 +73,7 @@ regfree(regex_t *preg)
         free(g->sets);
         free(g->setbits);
         free(g->must);
+        free(g->bitpar);
+        free(g->fold);
         free(g);
 }
@@ -79,12 +79,21 @@ int
 v_screen_end(SCR *sp)
 {
         VI_PRIVATE *vip;
+        size_t cnt;
 
         if ((vip = VIP(sp)) == NULL)
                 return (0);
+        for (cnt = 0; cnt < VLAY_MAX; ++cnt) {
+                free(vip->vlay[cnt].brk);
+                free(vip->vlay[cnt].ckp);
+        }
         free(vip->keyw);
+        free(vip->isrch);
         free(vip->rep);
         free(vip->ps);
+        free(vip->vrows);
+        free(vip->vrtext);
+        free(vip->rbuf);
         free(HMAP);
         free(vip);
         sp->vi_private = NULL;
@@ -197,6 +197,10 @@ v_exaddr(SCR *sp, VICMD *vp, dir_t dir)
                 goto err2;
         }
 
+        /* Start the match index, or report the match's position. */
+        if (search_index(sp, vp->m_stop.lno))
+                goto err2;
+
         /*
          * !!!
          * Historic practice is that a trailing 'z' was ignored if it was a
@@ -372,6 +376,10 @@ v_search(SCR *sp, VICMD *vp, char *ptrn, size_t plen, unsigned int flags, dir_t
                 abort();
         }
 
+        /* Start the match index, or report the match's position. */
+        if (search_index(sp, vp->m_stop.lno))
+                return (1);
+
         /* Correct motion commands, otherwise, simply move to the location. */
         if (ISMOTION(vp)) {
                 if (v_correct(sp, vp, 0))
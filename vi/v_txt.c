@@ -183,6 +183,7 @@ txt_map_end(SCR *sp)
                  * lines that might have been overwritten.
                  */
                 if (IS_SMALL(sp)) {
+                        VI_SCR_DAMAGE(vip);
                         for (cnt = sp->t_rows; cnt <= sp->t_maxrows; ++cnt) {
                                 (void)sp->gp->scr_move(sp, cnt, 0);
                                 (void)sp->gp->scr_clrtoeol(sp);
@@ -453,6 +454,7 @@ newtp:          if ((tp = text_init(sp, lp, len, len + 32)) == NULL)
         nochange = 0;
         FL_INIT(is_flags,
             LF_ISSET(TXT_SEARCHINCR) ? IS_RESTART | IS_RUNNING : 0);
+        VIP(sp)->isrch_len = 0;
         filec_redraw = hexcnt = showmatch = 0;
 
         /* Initialize input flags. */
@@ -2504,6 +2506,12 @@ txt_insch(SCR *sp, TEXT *tp, CHAR_T *chp, unsigned int flags)
         return (0);
 }
 
+/*
+ * Characters that can make an RE match something other than themselves,
+ * for any setting of the magic and extended options.
+ */
+#define ISRCH_MAGIC     "$()*+.?[\\]^{|}~"
+
 /*
  * txt_isrch --
  *      Do an incremental search.
@@ -2511,8 +2519,10 @@ txt_insch(SCR *sp, TEXT *tp, CHAR_T *chp, unsigned int flags)
 static int
 txt_isrch(SCR *sp, VICMD *vp, TEXT *tp, u_int8_t *is_flagsp)
 {
+        VI_PRIVATE *vip;
         MARK start;
         recno_t lno;
+        size_t i;
         unsigned int sf;
 
         /* If it's a one-line screen, we don't do incrementals. */
@@ -2560,6 +2570,22 @@ txt_isrch(SCR *sp, VICMD *vp, TEXT *tp, u_int8_t *is_flagsp)
                 return (0);
         }
 
+        /*
+         * If the last search failed, and the pattern has only been added to
+         * since, it can't match now unless it has characters that match
+         * something other than themselves.  Don't search the whole file
+         * again for each character typed after a miss.
+         */
+        vip = VIP(sp);
+        if (vip->isrch_len != 0 && vip->isrch_len <= tp->cno &&
+            !memcmp(vip->isrch, tp->lb, vip->isrch_len)) {
+                for (i = 1; i < tp->cno; ++i)
+                        if (strchr(ISRCH_MAGIC, tp->lb[i]) != NULL)
+                                break;
+                if (i == tp->cno)
+                        return (0);
+        }
+
         /*
          * Remember the input line and discard the special input map,
          * but don't overwrite the input line on the screen.
@@ -2594,11 +2620,21 @@ txt_isrch(SCR *sp, VICMD *vp, TEXT *tp, u_int8_t *is_flagsp)
                 sp->cno = vp->m_final.cno;
                 FL_CLR(*is_flagsp, IS_RESTART);
 
+                vip->isrch_len = 0;
                 if (!KEYS_WAITING(sp) && vs_refresh(sp, 0))
                         return (1);
-        } else
+        } else {
                 FL_SET(*is_flagsp, IS_RESTART);
 
+                /* Remember the miss, unless it was interrupted. */
+                vip->isrch_len = 0;
+                if (!INTERRUPTED(sp)) {
+                        BINC_RET(sp, vip->isrch, vip->isrch_blen, tp->cno);
+                        memcpy(vip->isrch, tp->lb, tp->cno);
+                        vip->isrch_len = tp->cno;
+                }
+        }
+
         /* Reinstantiate the special input map. */
         if (txt_map_init(sp))
                 return (1);
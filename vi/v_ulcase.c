@@ -27,7 +27,7 @@
 #include "../common/common.h"
 #include "vi.h"
 
-static int ulcase(SCR *, recno_t, CHAR_T *, size_t, size_t, size_t);
+static int ulcase(SCR *, LRANGE *, recno_t, CHAR_T *, size_t, size_t, size_t);
 
 /*
  * v_ulcase -- [count]~
@@ -48,6 +48,7 @@ static int ulcase(SCR *, recno_t, CHAR_T *, size_t, size_t, size_t);
 int
 v_ulcase(SCR *sp, VICMD *vp)
 {
+        LRANGE r;
         recno_t lno;
         size_t cno, lcnt, len;
         unsigned long cnt;
@@ -56,12 +57,13 @@ v_ulcase(SCR *sp, VICMD *vp)
         lno = vp->m_start.lno;
         cno = vp->m_start.cno;
 
+        memset(&r, 0, sizeof(LRANGE));
         for (cnt = F_ISSET(vp, VC_C1SET) ? vp->count : 1; cnt > 0; cno = 0) {
                 /* SOF is an error, EOF is an infinite count sink. */
                 if (db_get(sp, lno, 0, &p, &len)) {
                         if (lno == 1) {
                                 v_emsg(sp, NULL, VIM_EMPTY);
-                                return (1);
+                                goto err;
                         }
                         --lno;
                         break;
@@ -86,12 +88,17 @@ v_ulcase(SCR *sp, VICMD *vp)
                         vp->m_final.cno = lcnt + 1;
                 }
 
-                if (ulcase(sp, lno, p, len, cno, lcnt))
-                        return (1);
+                if (ulcase(sp, &r, lno, p, len, cno, lcnt))
+                        goto err;
 
                 if (cnt > 0)
                         ++lno;
         }
+        if (db_rcommit(sp, &r)) {
+err:            db_rfree(&r);
+                return (1);
+        }
+        db_rfree(&r);
 
         vp->m_final.lno = lno;
         return (0);
@@ -106,22 +113,29 @@ v_ulcase(SCR *sp, VICMD *vp)
 int
 v_mulcase(SCR *sp, VICMD *vp)
 {
+        LRANGE r;
         CHAR_T *p;
         size_t len;
         recno_t lno;
 
+        memset(&r, 0, sizeof(LRANGE));
         for (lno = vp->m_start.lno;;) {
                 if (db_get(sp, lno, DBG_FATAL, (char **) &p, &len))
-                        return (1);
-                if (len != 0 && ulcase(sp, lno, p, len,
+                        goto err;
+                if (len != 0 && ulcase(sp, &r, lno, p, len,
                     lno == vp->m_start.lno ? vp->m_start.cno : 0,
                     !F_ISSET(vp, VM_LMODE) &&
                     lno == vp->m_stop.lno ? vp->m_stop.cno : len))
-                        return (1);
+                        goto err;
 
                 if (++lno > vp->m_stop.lno)
                         break;
         }
+        if (db_rcommit(sp, &r)) {
+err:            db_rfree(&r);
+                return (1);
+        }
+        db_rfree(&r);
 
         /*
          * XXX
@@ -137,10 +151,11 @@ v_mulcase(SCR *sp, VICMD *vp)
 
 /*
  * ulcase --
- *      Change part of a line's case.
+ *      Change part of a line's case, staging the changed line.
  */
 static int
-ulcase(SCR *sp, recno_t lno, CHAR_T *lp, size_t len, size_t scno, size_t ecno)
+ulcase(SCR *sp, LRANGE *rp, recno_t lno, CHAR_T *lp, size_t len,
+    size_t scno, size_t ecno)
 {
         size_t blen;
         int change, rval;
@@ -162,7 +177,7 @@ ulcase(SCR *sp, recno_t lno, CHAR_T *lp, size_t len, size_t scno, size_t ecno)
                 }
         }
 
-        if (change && db_set(sp, lno, bp, len))
+        if (change && db_rset(sp, rp, lno, bp, len))
                 rval = 1;
 
         FREE_SPACE(sp, bp, blen);
@@ -486,8 +486,8 @@ v_cmd(SCR *sp, VICMD *dp, VICMD *vp, VICMD *ismotion, int *comcountp,
          * be alerted.
          */
         cpart = ismotion == NULL ? COMMANDMODE : ISPARTIAL;
-        if ((gcret =
-            v_key(sp, ismotion == NULL, &ev, EC_MAPCOMMAND)) != GC_OK) {
+        if ((gcret = v_key(sp, ismotion == NULL, &ev,
+            EC_MAPCOMMAND | (ismotion == NULL ? EC_IDLE : 0))) != GC_OK) {
                 if (gcret == GC_EVENT)
                         vp->ev = ev;
                 return (gcret);
@@ -968,6 +968,9 @@ v_init(SCR *sp)
         F_CLR(sp, SC_EX | SC_SCR_EX);
         F_SET(sp, SC_VI);
 
+        /* Changes made in ex weren't reported to the screen. */
+        VI_SCR_CFLUSH(vip);
+
         /*
          * Initialize screen values.
          *
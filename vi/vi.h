@@ -224,6 +224,50 @@ typedef struct _smap {
 #define SMAP_CACHE(smp)         ((smp)->c_ecsize != 0)
 #define SMAP_FLUSH(smp)         ((smp)->c_ecsize = 0)
 
+/*
+ * Structure for remembering what vs_line() last painted in each text row of
+ * the screen.  If a row is repainted with the same contents, it isn't handed
+ * to the screen support again.  The contents themselves are kept, in the
+ * vi_private vrtext array, and compared; the hash only rejects most changed
+ * rows quickly.  Anything else that writes into the text rows has to forget
+ * what's there, see VI_SCR_DAMAGE.  A zero hash means that the contents of
+ * the row aren't known.
+ */
+typedef struct _vrow {
+        u_int32_t hash;         /* Hash of the row contents. */
+        u_int32_t len;          /* Length of the row contents. */
+        int       clr;          /* If cleared to the end of the row. */
+} VROW;
+
+/*
+ * Structure for remembering the layout of a line that folds onto more than
+ * one screen, so that it isn't walked from the start every time the screen
+ * needs to know how many screens it takes or where one of them starts.  Very
+ * long lines also get checkpoints of the vs_columns() state every VL_CKSTEP
+ * bytes, so finding the column of a character, or the character at a column
+ * of a leftright screen, only walks from the nearest checkpoint.  An entry is
+ * only good for the generation of the cache it was filled in for, see
+ * VI_SCR_CFLUSH, and vs_change() keeps the line numbers up to date.
+ */
+typedef struct _vlay {
+        recno_t  lno;           /* 1-N: file line number. */
+        u_long   gen;           /* Cache generation. */
+        size_t   screens;       /* Screens in the line. */
+        size_t  *brk;           /* Screen starts: byte, character offset. */
+        size_t   nbrk;          /* Screen starts in brk. */
+        size_t   brklen;        /* Length of brk. */
+        size_t  *ckp;           /* Checkpoints: byte, scno, curoff. */
+        size_t   nckp;          /* Checkpoints in ckp. */
+        size_t   ckplen;        /* Length of ckp. */
+
+#define VL_BREAKS       0x01    /* Screen starts are filled in. */
+#define VL_SCREENS      0x02    /* Screens are filled in. */
+        u_int8_t flags;
+} VLAY;
+#define VLAY_MAX        16      /* Lines in the layout cache. */
+#define VL_CKSTEP       256     /* Bytes between column checkpoints. */
+#define VL_LONG         (8 * VL_CKSTEP) /* Lines long enough to checkpoint. */
+
                                 /* Character search information. */
 typedef enum { CNOTSET, FSEARCH, fSEARCH, TSEARCH, tSEARCH } cdir_t;
 
@@ -275,8 +319,13 @@ typedef struct _vi_private {
         CHAR_T  lastckey;       /* Last search character. */
         cdir_t  csearchdir;     /* Character search direction. */
 
+        char   *isrch;          /* Incremental search that failed. */
+        size_t  isrch_len;      /* Failed search length. */
+        size_t  isrch_blen;     /* Failed search buffer length. */
+
         SMAP   *h_smap;         /* First slot of the line map. */
         SMAP   *t_smap;         /* Last slot of the line map. */
+        long    sm_delta;       /* Bulk change: lines added before the map. */
 
         /*
          * One extra slot is always allocated for the map so that we can use
@@ -304,9 +353,20 @@ typedef struct _vi_private {
 #define _TMAP(sp)       (VIP(sp)->t_smap)
 #define TMAP            _TMAP(sp)
 
-        recno_t ss_lno; /* 1-N: vi_opt_screens cached line number. */
-        size_t  ss_screens;     /* vi_opt_screens cached return value. */
-#define VI_SCR_CFLUSH(vip)      ((vip)->ss_lno = OOBLNO)
+        VLAY    vlay[VLAY_MAX]; /* Line layout cache. */
+        u_long  vl_gen;         /* Line layout cache generation. */
+        size_t  vl_next;        /* Next layout cache entry to reuse. */
+#define VI_SCR_CFLUSH(vip)      (++(vip)->vl_gen)
+
+        VROW   *vrows;          /* Painted row contents. */
+        char   *vrtext;         /* Painted row text, vr_width bytes a row. */
+        size_t  vr_rows;        /* Rows in the vrows array. */
+        size_t  vr_width;       /* Bytes of text kept for each row. */
+        size_t  vr_cols;        /* Columns when rows painted, 0 if damaged. */
+        size_t  vr_woff;        /* Screen offset when rows painted. */
+#define VI_SCR_DAMAGE(vip)      ((vip)->vr_cols = 0)
+        char   *rbuf;           /* Row output buffer. */
+        size_t  rblen;          /* Row output buffer length. */
 
         size_t  srows;          /* 1-N: rows in the terminal/window. */
         recno_t olno;           /* 1-N: old cursor file line. */
@@ -323,6 +383,7 @@ typedef struct _vi_private {
 #define VIP_RCM_LAST    0x0040  /* Cursor drawn to the last column. */
 #define VIP_S_MODELINE  0x0080  /* Skip next modeline refresh. */
 #define VIP_S_REFRESH   0x0100  /* Skip next refresh. */
+#define VIP_N_BULK      0x0200  /* Bulk change: reformat when it ends. */
         u_int16_t flags;
 } VI_PRIVATE;
 
@@ -331,6 +392,7 @@ typedef struct _vi_private {
 
 #define O_NUMBER_FMT    "%6lu "                 /* O_NUMBER format, length. */
 #define O_NUMBER_LENGTH 7
+#define O_NUMBER_MAX    32                      /* Buffer for large numbers. */
 
 /* Screen columns. */
 #define SCREEN_COLS(sp) \
@@ -19,11 +19,15 @@
 #include <bitstring.h>
 #include <limits.h>
 #include <stdio.h>
+#include <bsd_stdlib.h>
 #include <bsd_string.h>
 
 #include "../common/common.h"
 #include "vi.h"
 
+static int vs_breaks(SCR *, VLAY *, char *, size_t);
+static int vs_paintrow(SCR *, SMAP *, size_t, int);
+
 /*
  * vs_line --
  *      Update one line on the screen.
@@ -36,12 +40,14 @@ vs_line(SCR *sp, SMAP *smp, size_t *yp, size_t *xp)
         CHAR_T *kp;
         GS *gp;
         SMAP *tsmp;
+        VI_PRIVATE *vip;
+        VLAY *vlp;
         size_t chlen = 0, cno_cnt, cols_per_screen, len, nlen;
         size_t offset_in_char, offset_in_line, oldx, oldy;
-        size_t scno, skip_cols, skip_screens;
+        size_t scno, skip_cols, skip_screens, *ckp;
         int ch = 0, dne, is_cached, is_partial, is_tab, no_draw;
         int list_tab, list_dollar;
-        char *p, *cbp, *ecbp, cbuf[128];
+        char *p, *cbp;
 
 #if defined(DEBUG) && 0
         TRACE(sp, "vs_line: row %u: line: %u off: %u\n",
@@ -67,6 +73,16 @@ vs_line(SCR *sp, SMAP *smp, size_t *yp, size_t *xp)
         if (yp == NULL && (is_cached || no_draw))
                 return (0);
 
+        /*
+         * The row is built in a buffer and handed to the screen in a single
+         * piece.  Leave room for a full row, a line number that's wider than
+         * its field, and a trailing '$'.
+         */
+        vip = VIP(sp);
+        BINC_RET(sp, vip->rbuf,
+            vip->rblen, sp->cols + O_NUMBER_MAX + MAX_CHARACTER_COLUMNS);
+        cbp = vip->rbuf;
+
         /*
          * A nasty side effect of this routine is that it returns the screen
          * position for the "current" character.  Not pretty, but this is the
@@ -129,11 +145,11 @@ vs_line(SCR *sp, SMAP *smp, size_t *yp, size_t *xp)
                 if (O_ISSET(sp, O_NUMBER)) {
                         cols_per_screen -= O_NUMBER_LENGTH;
                         if ((!dne || smp->lno == 1) && skip_cols == 0) {
-                                nlen = snprintf(cbuf, sizeof(cbuf),
+                                nlen = snprintf(cbp, O_NUMBER_MAX,
                                     O_NUMBER_FMT, (unsigned long)smp->lno);
-                                if (nlen >= sizeof(cbuf))
-                                        nlen = sizeof(cbuf) - 1;
-                                (void)gp->scr_addstr(sp, cbuf, nlen);
+                                if (nlen >= O_NUMBER_MAX)
+                                        nlen = O_NUMBER_MAX - 1;
+                                cbp += nlen;
                         }
                 }
         }
@@ -176,12 +192,13 @@ vs_line(SCR *sp, SMAP *smp, size_t *yp, size_t *xp)
                         } else
                                 if (list_dollar) {
                                         ch = '$';
-empty:                                  (void)gp->scr_addstr(sp,
+empty:                                  memcpy(cbp,
                                             KEY_NAME(sp, ch), KEY_LEN(sp, ch));
+                                        cbp += KEY_LEN(sp, ch);
                                 }
                 }
 
-                (void)gp->scr_clrtoeol(sp);
+                (void)vs_paintrow(sp, smp, cbp - vip->rbuf, 1);
                 (void)gp->scr_move(sp, oldy, oldx);
                 return (0);
         }
@@ -250,6 +267,14 @@ empty:                                  (void)gp->scr_addstr(sp,
 
         /* Do it the hard way, for leftright scrolling screens. */
         if (O_ISSET(sp, O_LEFTRIGHT)) {
+                /* Start very long lines from the closest checkpoint. */
+                if (!F_ISSET(sp, SC_TINPUT_INFO) && len > VL_LONG &&
+                    (vlp = vs_layout(sp, smp->lno, 1)) != NULL &&
+                    (ckp = vs_ckpt(sp, vlp, p, len, skip_cols, 1)) != NULL) {
+                        offset_in_line = ckp[0];
+                        scno = ckp[2];
+                        p = &p[offset_in_line];
+                }
                 for (; offset_in_line < len; ++offset_in_line) {
                         chlen = (ch = *(unsigned char *)p++) == '\t' && !list_tab ?
                             TAB_OFF(scno) : KEY_LEN(sp, ch);
@@ -272,6 +297,24 @@ empty:                                  (void)gp->scr_addstr(sp,
                 }
         }
 
+        /*
+         * If the screen starts of the line have been found before, look
+         * them up.  They don't depend on which screen is being displayed.
+         */
+        else if (!F_ISSET(sp, SC_TINPUT_INFO) &&
+            (vlp = vs_layout(sp, smp->lno, 1)) != NULL &&
+            (F_ISSET(vlp, VL_BREAKS) || !vs_breaks(sp, vlp, p, len)) &&
+            skip_screens <= vlp->nbrk) {
+                smp->c_sboff =
+                    offset_in_line = vlp->brk[(skip_screens - 1) * 2];
+                smp->c_scoff =
+                    offset_in_char = vlp->brk[(skip_screens - 1) * 2 + 1];
+                p = &p[offset_in_line];
+
+                /* Set cols_per_screen to 2nd and later line length. */
+                cols_per_screen = sp->cols;
+        }
+
         /* Do it the hard way, for historic line-folding screens. */
         else {
                 for (; offset_in_line < len; ++offset_in_line) {
@@ -321,8 +364,6 @@ display:
         } else
                 cno_cnt = (sp->cno - offset_in_line) + 1;
 
-        ecbp = (cbp = cbuf) + sizeof(cbuf) - 1;
-
         /* This is the loop that actually displays characters. */
         for (is_partial = 0, scno = 0;
             offset_in_line < len; ++offset_in_line, offset_in_char = 0) {
@@ -392,30 +433,20 @@ display:
                 if (is_cached)
                         continue;
 
-#define FLUSH(gp, sp, cbp, cbuf) do {                                   \
-        *(cbp) = '\0';                                                  \
-        (void)(gp)->scr_addstr((sp), (cbuf), (cbp) - (cbuf));           \
-        (cbp) = (cbuf);                                                 \
-} while (0)
                 /*
                  * Display the character.  We do tab expansion here because
                  * the screen interface doesn't have any way to set the tab
-                 * length.  Note, it's theoretically possible for chlen to
-                 * be larger than cbuf, if the user set a impossibly large
-                 * tabstop.
+                 * length.  The character was clipped to the screen width
+                 * above, so it always fits in the row buffer.
                  */
                 if (is_tab)
                         while (chlen--) {
-                                if (cbp >= ecbp)
-                                        FLUSH(gp, sp, cbp, cbuf);
                                 if (O_ISSET(sp, O_VISIBLETAB))
                                     *cbp++ = '~';
                                 else
                                     *cbp++ = ' ';
                         }
                 else {
-                        if (cbp + chlen >= ecbp)
-                                FLUSH(gp, sp, cbp, cbuf);
                         for (kp = KEY_NAME(sp, ch) + offset_in_char; chlen--;)
                                 *cbp++ = *kp++;
                 }
@@ -435,25 +466,201 @@ display:
                         ++scno;
 
                         chlen = KEY_LEN(sp, '$');
-                        if (cbp + chlen >= ecbp)
-                                FLUSH(gp, sp, cbp, cbuf);
                         for (kp = KEY_NAME(sp, '$'); chlen--;)
                                 *cbp++ = *kp++;
                 }
-
-                /* If still didn't paint the whole line, clear the rest. */
-                if (scno < cols_per_screen)
-                        (void)gp->scr_clrtoeol(sp);
         }
 
-        /* Flush any buffered characters. */
-        if (cbp > cbuf)
-                FLUSH(gp, sp, cbp, cbuf);
+        /*
+         * Write the row.  If we still didn't paint the whole line, clear
+         * the rest.
+         */
+        if (!is_cached)
+                (void)vs_paintrow(sp,
+                    smp, cbp - vip->rbuf, scno < cols_per_screen);
 
 ret1:   (void)gp->scr_move(sp, oldy, oldx);
         return (0);
 }
 
+/*
+ * vs_breaks --
+ *      Fill in the screen starts of a line in its layout cache entry.
+ *      This is the line-folding loop in vs_line(), run to the end of
+ *      the line.
+ */
+static int
+vs_breaks(SCR *sp, VLAY *vlp, char *p, size_t len)
+{
+        size_t chlen, cols_per_screen, off, scno;
+        int ch, list_tab;
+
+        list_tab = O_ISSET(sp, O_LIST);
+        cols_per_screen = sp->cols;
+        if (O_ISSET(sp, O_NUMBER))
+                cols_per_screen -= O_NUMBER_LENGTH;
+
+        for (vlp->nbrk = 0, off = scno = 0; off < len; ++off) {
+                chlen = (ch = *(unsigned char *)p++) == '\t' && !list_tab ?
+                    TAB_OFF(scno) : KEY_LEN(sp, ch);
+                if ((scno += chlen) < cols_per_screen)
+                        continue;
+                scno -= cols_per_screen;
+                cols_per_screen = sp->cols;
+
+                if ((vlp->nbrk + 1) * 2 > vlp->brklen) {
+                        vlp->brklen = vlp->brklen == 0 ? 64 : vlp->brklen * 2;
+                        REALLOCARRAY(sp,
+                            vlp->brk, vlp->brklen, sizeof(size_t));
+                        if (vlp->brk == NULL) {
+                                vlp->brklen = vlp->nbrk = 0;
+                                return (1);
+                        }
+                }
+                if (scno != 0) {
+                        vlp->brk[vlp->nbrk * 2] = off;
+                        vlp->brk[vlp->nbrk * 2 + 1] = chlen - scno;
+                } else {
+                        vlp->brk[vlp->nbrk * 2] = off + 1;
+                        vlp->brk[vlp->nbrk * 2 + 1] = 0;
+                }
+                ++vlp->nbrk;
+        }
+        F_SET(vlp, VL_BREAKS);
+        return (0);
+}
+
+/*
+ * vs_paintrow --
+ *      Write a row built by vs_line(), unless it's already on the screen.
+ */
+static int
+vs_paintrow(SCR *sp, SMAP *smp, size_t len, int clr)
+{
+        GS *gp;
+        VI_PRIVATE *vip;
+        VROW *vr;
+        u_int32_t hash;
+        size_t cnt, row, width;
+        unsigned char *p;
+        char *text;
+
+        gp = sp->gp;
+        vip = VIP(sp);
+
+        /*
+         * Only the text rows are remembered, the info line belongs to the
+         * message code.  If the screen has moved or changed size since the
+         * rows were painted, forget all of them.  A row holds no more than
+         * the row buffer vs_line() builds it in.
+         */
+        vr = NULL;
+        text = NULL;
+        hash = 0;
+        if ((row = smp - HMAP) < LASTLINE(sp)) {
+                if (vip->vr_cols != sp->cols ||
+                    vip->vr_woff != sp->woff || vip->vr_rows != LASTLINE(sp)) {
+                        width = sp->cols +
+                            O_NUMBER_MAX + MAX_CHARACTER_COLUMNS;
+                        REALLOCARRAY(sp,
+                            vip->vrows, LASTLINE(sp), sizeof(VROW));
+                        if (vip->vrows != NULL)
+                                REALLOCARRAY(sp,
+                                    vip->vrtext, LASTLINE(sp), width);
+                        if (vip->vrows == NULL || vip->vrtext == NULL) {
+                                free(vip->vrows);
+                                vip->vrows = NULL;
+                                vip->vr_rows = 0;
+                                VI_SCR_DAMAGE(vip);
+                                goto paint;
+                        }
+                        memset(vip->vrows, 0, LASTLINE(sp) * sizeof(VROW));
+                        vip->vr_rows = LASTLINE(sp);
+                        vip->vr_width = width;
+                        vip->vr_cols = sp->cols;
+                        vip->vr_woff = sp->woff;
+                }
+                vr = vip->vrows + row;
+                text = vip->vrtext + row * vip->vr_width;
+
+                /*
+                 * The colon command line can be painted in a text row of a
+                 * small screen, and messages may be written over it.
+                 */
+                if (F_ISSET(sp, SC_TINPUT_INFO) || len > vip->vr_width) {
+                        vr->hash = 0;
+                        vr = NULL;
+                        goto paint;
+                }
+
+                /*
+                 * FNV-1a, folding in the clear-to-end-of-line flag.  Only a
+                 * row with the same hash has its text compared.
+                 */
+                for (hash = 2166136261U,
+                    p = (unsigned char *)vip->rbuf, cnt = len; cnt--;)
+                        hash = (hash ^ *p++) * 16777619U;
+                if ((hash = (hash ^ clr) * 16777619U) == 0)
+                        hash = 1;
+                if (vr->hash == hash && vr->len == len && vr->clr == clr &&
+                    memcmp(text, vip->rbuf, len) == 0)
+                        return (0);
+        }
+
+paint:  if (len != 0 && gp->scr_addstr(sp, vip->rbuf, len))
+                goto err;
+        if (clr && gp->scr_clrtoeol(sp))
+                goto err;
+        if (vr != NULL) {
+                memcpy(text, vip->rbuf, len);
+                vr->hash = hash;
+                vr->len = len;
+                vr->clr = clr;
+        }
+        return (0);
+
+err:    if (vr != NULL)
+                vr->hash = 0;
+        return (1);
+}
+
+/*
+ * vs_rowmove --
+ *      Track rows of the screen being moved by inserting (cnt > 0) or
+ *      deleting (cnt < 0) rows at row.  The rows coming onto the screen
+ *      are blank or belonged to the info line.
+ *
+ * PUBLIC: void vs_rowmove(SCR *, size_t, long);
+ */
+void
+vs_rowmove(SCR *sp, size_t row, long cnt)
+{
+        VI_PRIVATE *vip;
+        size_t n, rows, width;
+
+        vip = VIP(sp);
+        if (vip->vr_cols == 0 || row >= (rows = vip->vr_rows))
+                return;
+        width = vip->vr_width;
+        if (cnt < 0) {
+                if ((n = -cnt) > rows - row)
+                        n = rows - row;
+                memmove(vip->vrows + row,
+                    vip->vrows + row + n, (rows - row - n) * sizeof(VROW));
+                memmove(vip->vrtext + row * width,
+                    vip->vrtext + (row + n) * width, (rows - row - n) * width);
+                memset(vip->vrows + rows - n, 0, n * sizeof(VROW));
+        } else {
+                if ((n = cnt) > rows - row)
+                        n = rows - row;
+                memmove(vip->vrows + row + n,
+                    vip->vrows + row, (rows - row - n) * sizeof(VROW));
+                memmove(vip->vrtext + (row + n) * width,
+                    vip->vrtext + row * width, (rows - row - n) * width);
+                memset(vip->vrows + row, 0, n * sizeof(VROW));
+        }
+}
+
 /*
  * vs_number --
  *      Repaint the numbers on all the lines.
@@ -486,6 +693,9 @@ vs_number(SCR *sp)
          */
         exist = db_exist(sp, TMAP->lno + 1);
 
+        /* The rows no longer hold what vs_line() painted. */
+        VI_SCR_DAMAGE(VIP(sp));
+
         (void)gp->scr_cursor(sp, &oldy, &oldx);
         for (smp = HMAP; smp <= TMAP; ++smp) {
                 /* Numbers are only displayed for the first screen line. */
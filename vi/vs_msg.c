@@ -427,6 +427,7 @@ vs_output(SCR *sp, mtype_t mtype, const char *line, int llen)
                 if (vip->lcontinue == 0) {
                         if (!IS_ONELINE(sp)) {
                                 if (vip->totalcount == 1) {
+                                        VI_SCR_DAMAGE(vip);
                                         (void)gp->scr_move(sp,
                                             LASTLINE(sp) - 1, 0);
                                         (void)gp->scr_clrtoeol(sp);
@@ -756,6 +757,8 @@ vs_scroll(SCR *sp, int *continuep, sw_t wtype)
         gp = sp->gp;
         vip = VIP(sp);
         if (!IS_ONELINE(sp)) {
+                VI_SCR_DAMAGE(vip);
+
                 /*
                  * Scroll the screen.  Instead of scrolling the entire screen,
                  * delete the line above the first line output so preserve the
@@ -69,6 +69,10 @@ vs_refresh(SCR *sp, int forcepaint)
 
         gp = sp->gp;
 
+        /* An ex command refreshing the screen as it goes, e.g., :s///c. */
+        if (gp->bulk != 0)
+                vs_bulk_flush(gp);
+
         /*
          * 1: Refresh the screen.
          *
@@ -77,8 +81,18 @@ vs_refresh(SCR *sp, int forcepaint)
          */
         if (F_ISSET(sp, SC_SCR_REDRAW))
                 TAILQ_FOREACH(tsp, &gp->dq, q)
-                        if (tsp != sp)
+                        if (tsp != sp) {
                                 F_SET(tsp, SC_SCR_REDRAW | SC_STATUS);
+                                VI_SCR_DAMAGE(VIP(tsp));
+                        }
+
+        /*
+         * If we're coming back from ex, it may have cleared or scrolled any
+         * part of the screen, forget what the screens' rows hold.
+         */
+        if (!F_ISSET(sp, SC_SCR_VI))
+                TAILQ_FOREACH(tsp, &gp->dq, q)
+                        VI_SCR_DAMAGE(VIP(tsp));
 
         /*
          * 2: Related or dirtied screens, or screens with messages.
@@ -176,6 +190,10 @@ vs_paint(SCR *sp, unsigned int flags)
         vip = VIP(sp);
         didpaint = leftright_warp = 0;
 
+        /* If ex wrote on the screen, its rows have to be repainted. */
+        if (F_ISSET(vip, VIP_N_EX_PAINT))
+                VI_SCR_DAMAGE(vip);
+
         /*
          * 5: Reformat the lines.
          *
@@ -272,7 +290,8 @@ vs_paint(SCR *sp, unsigned int flags)
                                                 return (1);
                                 }
                         else {
-small_fill:                     (void)gp->scr_move(sp, LASTLINE(sp), 0);
+small_fill:                     VI_SCR_DAMAGE(vip);
+                                (void)gp->scr_move(sp, LASTLINE(sp), 0);
                                 (void)gp->scr_clrtoeol(sp);
                                 for (; sp->t_rows > sp->t_minrows;
                                     --sp->t_rows, --TMAP) {
@@ -678,11 +697,13 @@ paint:  for (smp = HMAP; smp <= TMAP; ++smp)
          * If it's a small screen and we're redrawing, clear the unused lines,
          * ex may have overwritten them.
          */
-        if (F_ISSET(sp, SC_SCR_REDRAW) && IS_SMALL(sp))
+        if (F_ISSET(sp, SC_SCR_REDRAW) && IS_SMALL(sp)) {
+                VI_SCR_DAMAGE(vip);
                 for (cnt = sp->t_rows; cnt <= sp->t_maxrows; ++cnt) {
                         (void)gp->scr_move(sp, cnt, 0);
                         (void)gp->scr_clrtoeol(sp);
                 }
+        }
 
         didpaint = 1;
 
@@ -19,6 +19,7 @@
 #include <bitstring.h>
 #include <limits.h>
 #include <stdio.h>
+#include <bsd_stdlib.h>
 #include <bsd_string.h>
 
 #include "../common/common.h"
@@ -37,6 +38,20 @@ vs_column(SCR *sp, size_t *colp)
 
         vip = VIP(sp);
 
+        /*
+         * If vs_paint() couldn't find the cursor in the screen map, which
+         * can happen in lines longer than the screen, use the column of
+         * the cursor character in the line.
+         */
+        if (vip->sc_smap == NULL) {
+                *colp = vs_columns(sp, NULL, sp->lno, &sp->cno, NULL);
+                if (O_ISSET(sp, O_NUMBER))
+                        *colp -= O_NUMBER_LENGTH;
+                if (*colp != 0)
+                        --*colp;
+                return (0);
+        }
+
         *colp = (O_ISSET(sp, O_LEFTRIGHT) ?
             vip->sc_smap->coff : (vip->sc_smap->soff - 1) * sp->cols) +
             vip->sc_col - (O_ISSET(sp, O_NUMBER) ? O_NUMBER_LENGTH : 0);
@@ -54,6 +69,7 @@ vs_column(SCR *sp, size_t *colp)
 size_t
 vs_screens(SCR *sp, recno_t lno, size_t *cnop)
 {
+        VLAY *vlp;
         size_t cols, screens;
 
         /* Left-right screens are simple, it's always 1. */
@@ -66,9 +82,11 @@ vs_screens(SCR *sp, recno_t lno, size_t *cnop)
          * hack, lots of time the cursor is on column one, which is an easy
          * one.
          */
+        vlp = NULL;
         if (cnop == NULL) {
-                if (VIP(sp)->ss_lno == lno)
-                        return (VIP(sp)->ss_screens);
+                if ((vlp = vs_layout(sp, lno, 0)) != NULL &&
+                    F_ISSET(vlp, VL_SCREENS))
+                        return (vlp->screens);
         } else if (*cnop == 0)
                 return (1);
 
@@ -79,10 +97,14 @@ vs_screens(SCR *sp, recno_t lno, size_t *cnop)
         if (screens == 0)
                 screens = 1;
 
-        /* Cache the value. */
-        if (cnop == NULL) {
-                VIP(sp)->ss_lno = lno;
-                VIP(sp)->ss_screens = screens;
+        /*
+         * Cache the value.  Lines that fit on a single screen are cheap,
+         * and aren't worth an entry.
+         */
+        if (cnop == NULL && (vlp != NULL ||
+            (screens > 1 && (vlp = vs_layout(sp, lno, 1)) != NULL))) {
+                vlp->screens = screens;
+                F_SET(vlp, VL_SCREENS);
         }
         return (screens);
 }
@@ -97,8 +119,9 @@ vs_screens(SCR *sp, recno_t lno, size_t *cnop)
 size_t
 vs_columns(SCR *sp, char *lp, recno_t lno, size_t *cnop, size_t *diffp)
 {
-        size_t chlen, cno, curoff, last, len, scno;
-        int ch, leftright, listset;
+        VLAY *vlp;
+        size_t chlen, cno, curoff, last, len, scno, *ckp;
+        int ch, fromdb, leftright, listset;
         char *p;
 
         /*
@@ -114,7 +137,7 @@ vs_columns(SCR *sp, char *lp, recno_t lno, size_t *cnop, size_t *diffp)
         }
 
         /* Need the line to go any further. */
-        if (lp == NULL) {
+        if ((fromdb = lp == NULL)) {
                 (void)db_get(sp, lno, 0, &lp, &len);
                 if (len == 0)
                         goto done;
@@ -165,8 +188,18 @@ done:           if (diffp != NULL)              /* XXX */
                         scno += chlen;
                         TAB_RESET;
                 }
-        else
-                for (cno = *cnop;; --cno) {
+        else {
+                /* Start very long lines from the closest checkpoint. */
+                cno = *cnop;
+                if (fromdb && len > VL_LONG && cno < len &&
+                    (vlp = vs_layout(sp, lno, 1)) != NULL &&
+                    (ckp = vs_ckpt(sp, vlp, lp, len, cno, 0)) != NULL) {
+                        p = lp + ckp[0];
+                        scno = ckp[1];
+                        curoff = ckp[2];
+                        cno -= ckp[0];
+                }
+                for (;; --cno) {
                         chlen = CHLEN(curoff);
                         last = scno;
                         scno += chlen;
@@ -174,6 +207,7 @@ done:           if (diffp != NULL)              /* XXX */
                         if (cno == 0)
                                 break;
                 }
+        }
 
         /* Add the trailing '$' if the O_LIST option set. */
         if (listset && cnop == NULL)
@@ -189,6 +223,94 @@ done:           if (diffp != NULL)              /* XXX */
         return (scno);
 }
 
+/*
+ * vs_ckpt --
+ *      Return the last column checkpoint of a very long line at or before
+ *      a character, or, if bycol is set, before a screen column of a
+ *      leftright screen.  The checkpoints are filled in as far as needed.
+ *
+ * PUBLIC: size_t *vs_ckpt(SCR *, VLAY *, char *, size_t, size_t, int);
+ */
+size_t *
+vs_ckpt(SCR *sp, VLAY *vlp, char *lp, size_t len, size_t cno, int bycol)
+{
+        size_t chlen, cnt, curoff, lo, hi, mid, scno, *ckp;
+        int ch, leftright, listset;
+        char *p;
+
+        listset = O_ISSET(sp, O_LIST);
+        leftright = O_ISSET(sp, O_LEFTRIGHT);
+        if (bycol && !leftright)
+                return (NULL);
+
+        /* The first checkpoint is the start of the line. */
+        if (vlp->nckp == 0) {
+                if (vlp->ckplen < 3) {
+                        vlp->ckplen = 3 * 64;
+                        REALLOCARRAY(sp,
+                            vlp->ckp, vlp->ckplen, sizeof(size_t));
+                        if (vlp->ckp == NULL) {
+                                vlp->ckplen = 0;
+                                return (NULL);
+                        }
+                }
+                vlp->ckp[0] = 0;
+                vlp->ckp[1] = O_ISSET(sp, O_NUMBER) ? O_NUMBER_LENGTH : 0;
+                vlp->ckp[2] = 0;
+                vlp->nckp = 1;
+        }
+
+        /* Walk the line from the last checkpoint until it's past the target. */
+        for (;;) {
+                ckp = vlp->ckp + (vlp->nckp - 1) * 3;
+                if (ckp[0] + VL_CKSTEP >= len ||
+                    (bycol ? ckp[2] >= cno : ckp[0] + VL_CKSTEP > cno))
+                        break;
+
+                p = lp + ckp[0];
+                scno = ckp[1];
+                curoff = ckp[2];
+                for (cnt = VL_CKSTEP; cnt--;) {
+                        chlen = CHLEN(curoff);
+                        scno += chlen;
+                        TAB_RESET;
+                }
+
+                if (vlp->nckp * 3 + 3 > vlp->ckplen) {
+                        vlp->ckplen *= 2;
+                        REALLOCARRAY(sp,
+                            vlp->ckp, vlp->ckplen, sizeof(size_t));
+                        if (vlp->ckp == NULL) {
+                                vlp->ckplen = vlp->nckp = 0;
+                                return (NULL);
+                        }
+                }
+                ckp = vlp->ckp + vlp->nckp++ * 3;
+                ckp[0] = p - lp;
+                ckp[1] = scno;
+                ckp[2] = curoff;
+        }
+
+        if (!bycol) {
+                if ((mid = cno / VL_CKSTEP) >= vlp->nckp)
+                        mid = vlp->nckp - 1;
+                return (vlp->ckp + mid * 3);
+        }
+
+        /*
+         * Screen columns only increase in a leftright screen, find the last
+         * checkpoint before the column.
+         */
+        for (lo = 0, hi = vlp->nckp - 1; lo < hi;) {
+                mid = lo + (hi - lo + 1) / 2;
+                if (vlp->ckp[mid * 3 + 2] < cno)
+                        lo = mid;
+                else
+                        hi = mid - 1;
+        }
+        return (vlp->ckp + lo * 3);
+}
+
 /*
  * vs_rcm --
  *      Return the physical column from the line that will display a
@@ -295,3 +417,81 @@ vs_colpos(SCR *sp, recno_t lno, size_t cno)
         /* No such character; return the start of the last character. */
         return (llen - 1);
 }
+
+/*
+ * vs_layout --
+ *      Return the layout cache entry for a line.  If there isn't one and
+ *      create is set, reuse the oldest entry for it.
+ *
+ * PUBLIC: VLAY *vs_layout(SCR *, recno_t, int);
+ */
+VLAY *
+vs_layout(SCR *sp, recno_t lno, int create)
+{
+        VI_PRIVATE *vip;
+        VLAY *vlp;
+        size_t cnt;
+
+        /*
+         * If the screen is going to be reformatted, an option that changes
+         * the layout of the lines may have been set, and the cache won't be
+         * flushed until the reformat is done.
+         */
+        if (F_ISSET(sp, SC_SCR_REFORMAT))
+                return (NULL);
+
+        vip = VIP(sp);
+        for (vlp = vip->vlay, cnt = VLAY_MAX; cnt--; ++vlp)
+                if (vlp->lno == lno && vlp->gen == vip->vl_gen)
+                        return (vlp);
+        if (!create)
+                return (NULL);
+
+        vlp = &vip->vlay[vip->vl_next];
+        vip->vl_next = (vip->vl_next + 1) % VLAY_MAX;
+        vlp->lno = lno;
+        vlp->gen = vip->vl_gen;
+        vlp->nbrk = vlp->nckp = 0;
+        vlp->flags = 0;
+        return (vlp);
+}
+
+/*
+ * vs_layout_insdel --
+ *      Update the layout cache for a changed line.
+ *
+ * PUBLIC: void vs_layout_insdel(SCR *, lnop_t, recno_t);
+ */
+void
+vs_layout_insdel(SCR *sp, lnop_t op, recno_t lno)
+{
+        VI_PRIVATE *vip;
+        VLAY *vlp;
+        size_t cnt;
+
+        vip = VIP(sp);
+        for (vlp = vip->vlay, cnt = VLAY_MAX; cnt--; ++vlp) {
+                if (vlp->gen != vip->vl_gen)
+                        continue;
+                switch (op) {
+                case LINE_DELETE:
+                        if (vlp->lno > lno)
+                                --vlp->lno;
+                        else if (vlp->lno == lno)
+                                vlp->gen = vip->vl_gen - 1;
+                        break;
+                case LINE_APPEND:
+                        if (vlp->lno > lno)
+                                ++vlp->lno;
+                        break;
+                case LINE_INSERT:
+                        if (vlp->lno >= lno)
+                                ++vlp->lno;
+                        break;
+                case LINE_RESET:
+                        if (vlp->lno == lno)
+                                vlp->gen = vip->vl_gen - 1;
+                        break;
+                }
+        }
+}
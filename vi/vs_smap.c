@@ -74,8 +74,14 @@ vs_change(SCR *sp, recno_t lno, lnop_t op)
                 op = LINE_INSERT;
         }
 
-        /* Ignore the change if the line is after the map. */
-        if (lno > TMAP->lno)
+        /* The line layout cache includes lines that aren't displayed. */
+        vs_layout_insdel(sp, op, lno);
+
+        /*
+         * Ignore the change if the line is after the map.  In a bulk
+         * change, the map's line numbers may be off by sm_delta.
+         */
+        if (lno > TMAP->lno + vip->sm_delta)
                 return (0);
 
         /*
@@ -83,21 +89,27 @@ vs_change(SCR *sp, recno_t lno, lnop_t op)
          * the map.  If it's an increment, increment the map.  Otherwise,
          * ignore it.
          */
-        if (lno < HMAP->lno) {
+        if (lno < HMAP->lno + vip->sm_delta) {
                 switch (op) {
                 case LINE_APPEND:
                         abort();
                         /* NOTREACHED */
                 case LINE_DELETE:
-                        for (p = HMAP, cnt = sp->t_rows; cnt--; ++p)
-                                --p->lno;
+                        if (sp->gp->bulk != 0)
+                                --vip->sm_delta;
+                        else
+                                for (p = HMAP, cnt = sp->t_rows; cnt--; ++p)
+                                        --p->lno;
                         if (sp->lno >= lno)
                                 --sp->lno;
                         F_SET(vip, VIP_N_RENUMBER);
                         break;
                 case LINE_INSERT:
-                        for (p = HMAP, cnt = sp->t_rows; cnt--; ++p)
-                                ++p->lno;
+                        if (sp->gp->bulk != 0)
+                                ++vip->sm_delta;
+                        else
+                                for (p = HMAP, cnt = sp->t_rows; cnt--; ++p)
+                                        ++p->lno;
                         if (sp->lno >= lno)
                                 ++sp->lno;
                         F_SET(vip, VIP_N_RENUMBER);
@@ -110,11 +122,7 @@ vs_change(SCR *sp, recno_t lno, lnop_t op)
 
         F_SET(vip, VIP_N_REFRESH);
 
-        /*
-         * Invalidate the line size cache, and invalidate the cursor if it's
-         * on this line,
-         */
-        VI_SCR_CFLUSH(vip);
+        /* Invalidate the cursor if it's on this line. */
         if (sp->lno == lno)
                 F_SET(vip, VIP_CUR_INVALID);
 
@@ -129,6 +137,15 @@ vs_change(SCR *sp, recno_t lno, lnop_t op)
                 return (0);
         }
 
+        /*
+         * In a bulk change, the map is filled in again when the change
+         * ends, don't scroll and repaint the screen for each line.
+         */
+        if (sp->gp->bulk != 0) {
+                F_SET(vip, VIP_N_BULK);
+                return (0);
+        }
+
         /* Save and restore the cursor for these routines. */
         (void)sp->gp->scr_cursor(sp, &oldy, &oldx);
 
@@ -155,6 +172,57 @@ vs_change(SCR *sp, recno_t lno, lnop_t op)
         return (0);
 }
 
+/*
+ * vs_bulk --
+ *      Start or end a bulk change.  Ex commands can change any number of
+ *      lines, and updating the screen maps for each of them costs far more
+ *      than filling them in once.  While a bulk change is underway, changes
+ *      before a map only count the lines added, and changes in a map only
+ *      mark it; the maps are fixed up when the outermost bulk change ends.
+ *
+ * PUBLIC: void vs_bulk(SCR *, int);
+ */
+void
+vs_bulk(SCR *sp, int start)
+{
+        GS *gp;
+
+        gp = sp->gp;
+        if (start)
+                ++gp->bulk;
+        else if (--gp->bulk == 0)
+                vs_bulk_flush(gp);
+}
+
+/*
+ * vs_bulk_flush --
+ *      Fix up the maps of the displayed screens after bulk changes.
+ *
+ * PUBLIC: void vs_bulk_flush(GS *);
+ */
+void
+vs_bulk_flush(GS *gp)
+{
+        SCR *sp;
+        SMAP *p;
+        VI_PRIVATE *vip;
+        size_t cnt;
+
+        TAILQ_FOREACH(sp, &gp->dq, q) {
+                if ((vip = VIP(sp)) == NULL || HMAP == NULL)
+                        continue;
+                if (vip->sm_delta != 0) {
+                        for (p = HMAP, cnt = sp->t_rows; cnt--; ++p)
+                                p->lno += vip->sm_delta;
+                        vip->sm_delta = 0;
+                }
+                if (F_ISSET(vip, VIP_N_BULK)) {
+                        F_CLR(vip, VIP_N_BULK);
+                        F_SET(sp, SC_SCR_REFORMAT);
+                }
+        }
+}
+
 /*
  * vs_sm_fill --
  *      Fill in the screen map, placing the specified line at the
@@ -783,6 +851,7 @@ vs_deleteln(SCR *sp, int cnt)
                 (void)gp->scr_clrtoeol(sp);
         else {
                 (void)gp->scr_cursor(sp, &oldy, &oldx);
+                vs_rowmove(sp, oldy, -(long)cnt);
                 while (cnt--) {
                         (void)gp->scr_deleteln(sp);
                         (void)gp->scr_move(sp, LASTLINE(sp), 0);
@@ -954,6 +1023,7 @@ vs_sm_erase(SCR *sp)
         GS *gp;
 
         gp = sp->gp;
+        VI_SCR_DAMAGE(VIP(sp));
         (void)gp->scr_move(sp, LASTLINE(sp), 0);
         (void)gp->scr_clrtoeol(sp);
         for (; sp->t_rows > sp->t_minrows; --sp->t_rows, --TMAP) {
@@ -1010,6 +1080,7 @@ vs_insertln(SCR *sp, int cnt)
                 (void)gp->scr_clrtoeol(sp);
         } else {
                 (void)gp->scr_cursor(sp, &oldy, &oldx);
+                vs_rowmove(sp, oldy, cnt);
                 while (cnt--) {
                         (void)gp->scr_move(sp, LASTLINE(sp) - 1, 0);
                         (void)gp->scr_deleteln(sp);
@@ -153,6 +153,10 @@ vs_split(SCR *sp, SCR *new, int ccl)
                             IS_ONELINE(new) ? 1 : new->rows - 1;
         }
 
+        /* Forget what the screens' rows hold, they've moved. */
+        VI_SCR_DAMAGE(VIP(sp));
+        VI_SCR_DAMAGE(VIP(new));
+
         /* Adjust the ends of the new and old maps. */
         _TMAP(sp) = IS_ONELINE(sp) ?
             _HMAP(sp) : _HMAP(sp) + (sp->t_rows - 1);
@@ -251,6 +255,7 @@ vs_discard(SCR *sp, SCR **spp)
         sp->defscroll = sp->t_maxrows / 2;
         *(HMAP + (sp->t_rows - 1)) = *TMAP;
         TMAP = HMAP + (sp->t_rows - 1);
+        VI_SCR_DAMAGE(VIP(sp));
 
         /*
          * Draw the new screen from scratch, and add a status line.
@@ -402,6 +407,10 @@ vs_swap(SCR *sp, SCR **nspp, char *name)
         nsp->cols = sp->cols;
         nsp->rows = sp->rows;   /* XXX: Only place in vi that sets rows. */
         nsp->woff = sp->woff;
+        VI_SCR_DAMAGE(VIP(nsp));
+
+        /* Changes made while the screen was in the background were missed. */
+        VI_SCR_CFLUSH(VIP(nsp));
 
         /*
          * Small screens: see vs_refresh.c, section 6a.
@@ -539,6 +548,7 @@ toosmall:                       msgq(sp, M_BERR,
         g->t_maxrows += count;
         _TMAP(g) += count;
         F_SET(g, SC_SCR_REFORMAT | SC_STATUS);
+        VI_SCR_DAMAGE(VIP(g));
 
         s->t_rows -= count;
         s->t_maxrows -= count;
@@ -546,6 +556,7 @@ toosmall:                       msgq(sp, M_BERR,
                 s->t_minrows = s->t_maxrows;
         _TMAP(s) -= count;
         F_SET(s, SC_SCR_REFORMAT | SC_STATUS);
+        VI_SCR_DAMAGE(VIP(s));
 
         return (0);
 }